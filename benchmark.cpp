@@ -0,0 +1,265 @@
+/**
+ * HotLoader 性能基准程序
+ *
+ * 本程序测量各组件在典型规模下的性能：
+ * 1. IP ACL：LPM 表（hot_acl.h）的编译耗时、内存占用与查询延迟
+ * 2. 黑名单：最小完美哈希（hot_blocklist.h）与 std::unordered_set 的对比
+ * 3. 退出清理：大量 watch 时 unregister_all_tasks() 与 stop() 的耗时
+ *
+ * 编译命令：
+ * g++ -O2 benchmark.cpp -o benchmark -lpthread -std=c++17
+ *
+ * 运行方式：
+ * ./benchmark
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <map>
+#include <vector>
+#include <unordered_set>
+#include <fstream>
+#include <filesystem>
+
+#include "hot_acl.h"
+#include "hot_blocklist.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// ============================================================
+// 基准 1: IP ACL 最长前缀匹配
+// ============================================================
+void bench_acl_lookup() {
+    std::cout << "\n==================================================" << std::endl;
+    std::cout << "基准 1: IP ACL 最长前缀匹配" << std::endl;
+    std::cout << "==================================================" << std::endl;
+
+    constexpr int kRules = 300000;
+    constexpr int kLookups = 10000000;
+
+    // 生成规则文件内容：以 /24 为主，混合 /8 ~ /32
+    std::mt19937 rng(42);
+    std::string text;
+    std::vector<std::pair<uint32_t, int>> rules;
+    for (int i = 0; i < kRules; ++i) {
+        int length = (i % 10 == 0) ? 8 + static_cast<int>(rng() % 25) : 24;
+        uint32_t prefix = rng() & (~0u << (32 - length));
+        rules.emplace_back(prefix, length);
+
+        char line[64];
+        snprintf(line, sizeof(line), "%u.%u.%u.%u/%d %s\n",
+                 prefix >> 24, (prefix >> 16) & 0xff, (prefix >> 8) & 0xff, prefix & 0xff,
+                 length, (i % 3 == 0) ? "deny" : "allow");
+        text += line;
+    }
+
+    auto start = Clock::now();
+    std::shared_ptr<const HotIpAcl> acl = HotIpAcl::compile(text, HotIpAcl::DENY);
+    double compile_ms = elapsed_ms(start);
+
+    std::cout << "规则数: " << acl->rule_count() << std::endl;
+    std::cout << "编译耗时（含解析）: " << std::fixed << std::setprecision(1) << compile_ms << " ms" << std::endl;
+    std::cout << "LPM 表内存: " << acl->memory_usage() / 1024 << " KB" << std::endl;
+
+    // 查询地址一半命中已有规则，一半随机
+    std::vector<in_addr> addrs(1 << 16);
+    for (size_t i = 0; i < addrs.size(); ++i) {
+        uint32_t ip = rng();
+        if (i % 2 == 0) {
+            const auto& [prefix, length] = rules[rng() % rules.size()];
+            ip = prefix | (length == 32 ? 0 : (ip & (~0u >> length)));
+        }
+        addrs[i].s_addr = htonl(ip);
+    }
+
+    uint64_t checksum = 0;
+    start = Clock::now();
+    for (int i = 0; i < kLookups; ++i) {
+        checksum += acl->lookup(addrs[i & (addrs.size() - 1)]);
+    }
+    double lpm_ms = elapsed_ms(start);
+
+    // 对比：常见的 std::map 实现，按前缀长度从长到短逐个查找
+    std::map<std::pair<int, uint32_t>, int> table;
+    for (size_t i = 0; i < rules.size(); ++i) {
+        table[{rules[i].second, rules[i].first}] = (i % 3 == 0) ? HotIpAcl::DENY : HotIpAcl::ALLOW;
+    }
+
+    constexpr int kMapLookups = kLookups / 10;
+    uint64_t map_checksum = 0;
+    start = Clock::now();
+    for (int i = 0; i < kMapLookups; ++i) {
+        uint32_t ip = ntohl(addrs[i & (addrs.size() - 1)].s_addr);
+        for (int length = 32; length >= 0; --length) {
+            uint32_t mask = (length == 0) ? 0 : (~0u << (32 - length));
+            auto it = table.find({length, ip & mask});
+            if (it != table.end()) {
+                map_checksum += it->second;
+                break;
+            }
+        }
+    }
+    double map_ms = elapsed_ms(start);
+
+    std::cout << "LPM 表查询: " << std::setprecision(2) << lpm_ms * 1e6 / kLookups << " ns/次" << std::endl;
+    std::cout << "std::map 查询: " << map_ms * 1e6 / kMapLookups << " ns/次" << std::endl;
+    std::cout << "(checksum " << checksum << " / " << map_checksum << ")" << std::endl;
+}
+
+// ============================================================
+// 基准 2: 黑名单查询
+// ============================================================
+void bench_blocklist_lookup() {
+    std::cout << "\n==================================================" << std::endl;
+    std::cout << "基准 2: 黑名单最小完美哈希" << std::endl;
+    std::cout << "==================================================" << std::endl;
+
+    constexpr int kEntries = 1000000;
+    constexpr int kLookups = 10000000;
+
+    std::string text;
+    for (int i = 0; i < kEntries; ++i) {
+        text += "host" + std::to_string(i * 7919LL) + ".blocked.example.com\n";
+    }
+
+    auto start = Clock::now();
+    std::shared_ptr<const HotBlocklistTask::Set> set = HotBlocklistTask::compile(text);
+    double build_ms = elapsed_ms(start);
+
+    std::cout << "条目数: " << set->size() << std::endl;
+    std::cout << "构建耗时（含解析）: " << std::fixed << std::setprecision(1) << build_ms << " ms" << std::endl;
+    std::cout << "完美哈希内存: " << set->memory_usage() / 1024 << " KB ("
+              << std::setprecision(2) << static_cast<double>(set->memory_usage()) / set->size() << " 字节/条)"
+              << std::endl;
+
+    // 查询一半命中，一半不在名单中
+    std::mt19937 rng(42);
+    std::vector<std::string> keys(1 << 16);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        int id = static_cast<int>(rng() % kEntries);
+        keys[i] = (i % 2 == 0) ? "host" + std::to_string(id * 7919LL) + ".blocked.example.com"
+                               : "host" + std::to_string(id) + ".allowed.example.com";
+    }
+
+    uint64_t hits = 0;
+    start = Clock::now();
+    for (int i = 0; i < kLookups; ++i) {
+        hits += set->contains(keys[i & (keys.size() - 1)]);
+    }
+    double mph_ms = elapsed_ms(start);
+
+    // 对比：std::unordered_set<std::string>
+    std::unordered_set<std::string> table;
+    for (int i = 0; i < kEntries; ++i) {
+        table.insert("host" + std::to_string(i * 7919LL) + ".blocked.example.com");
+    }
+
+    uint64_t set_hits = 0;
+    start = Clock::now();
+    for (int i = 0; i < kLookups; ++i) {
+        set_hits += table.count(keys[i & (keys.size() - 1)]);
+    }
+    double set_ms = elapsed_ms(start);
+
+    std::cout << "完美哈希查询: " << mph_ms * 1e6 / kLookups << " ns/次" << std::endl;
+    std::cout << "std::unordered_set 查询: " << set_ms * 1e6 / kLookups << " ns/次" << std::endl;
+    std::cout << "(命中 " << hits << " / " << set_hits << ")" << std::endl;
+}
+
+// ============================================================
+// 基准 3: 退出清理
+// ============================================================
+class BenchTask : public HotLoadTask {
+public:
+    explicit BenchTask(const std::string& file)
+        : HotLoadTask(file) {}
+};
+
+static std::vector<std::string> make_bench_files(const std::string& dir, int count) {
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    std::vector<std::string> files;
+    for (int i = 0; i < count; ++i) {
+        files.push_back(dir + "/f" + std::to_string(i));
+        std::ofstream(files.back()) << i;
+    }
+    return files;
+}
+
+static std::vector<HotLoadTask*> register_bench_tasks(const std::vector<std::string>& files) {
+    std::vector<HotLoadTask*> tasks;
+    for (const auto& file : files) {
+        tasks.push_back(new BenchTask(file));
+        HotLoader::instance().register_task(tasks.back(), HotLoader::OWN_TASK);
+    }
+    return tasks;
+}
+
+void bench_teardown() {
+    std::cout << "\n==================================================" << std::endl;
+    std::cout << "基准 3: 退出清理" << std::endl;
+    std::cout << "==================================================" << std::endl;
+
+    constexpr int kFiles = 20000; // 受 /proc/sys/fs/inotify/max_user_watches 限制
+    const std::string dir = "/tmp/hotloader_bench_teardown";
+    std::vector<std::string> files = make_bench_files(dir, kFiles);
+
+    HotLoader& loader = HotLoader::instance();
+    loader.init();
+    loader.run();
+    std::cout << "watch 数: " << kFiles << std::endl;
+
+    // 对比：逐个注销，每个文件一次 inotify_rm_watch()
+    std::vector<HotLoadTask*> tasks = register_bench_tasks(files);
+    auto start = Clock::now();
+    for (HotLoadTask* task : tasks) {
+        loader.unregister_task(task);
+    }
+    std::cout << "逐个 unregister_task(): " << std::fixed << std::setprecision(1) << elapsed_ms(start) << " ms"
+              << std::endl;
+
+    register_bench_tasks(files);
+    start = Clock::now();
+    loader.unregister_all_tasks();
+    std::cout << "unregister_all_tasks()（重建 inotify 实例）: " << elapsed_ms(start) << " ms" << std::endl;
+
+    register_bench_tasks(files);
+    start = Clock::now();
+    loader.unregister_all_tasks(HotLoader::TEARDOWN_PARALLEL);
+    std::cout << "unregister_all_tasks(TEARDOWN_PARALLEL): " << elapsed_ms(start) << " ms" << std::endl;
+
+    register_bench_tasks(files);
+    start = Clock::now();
+    loader.unregister_all_tasks(HotLoader::TEARDOWN_DEFERRED);
+    std::cout << "unregister_all_tasks(TEARDOWN_DEFERRED) 返回: " << elapsed_ms(start) << " ms" << std::endl;
+
+    // stop() 通过 eventfd 唤醒工作线程，无需等待 epoll_wait 超时
+    register_bench_tasks(files);
+    start = Clock::now();
+    loader.stop();
+    std::cout << "stop()（含清理 " << kFiles << " 个任务）: " << elapsed_ms(start) << " ms" << std::endl;
+
+    std::filesystem::remove_all(dir);
+}
+
+// ============================================================
+// 主函数
+// ============================================================
+int main() {
+    std::cout << "========================================" << std::endl;
+    std::cout << "    HotLoader 性能基准" << std::endl;
+    std::cout << "========================================" << std::endl;
+
+    bench_acl_lookup();
+    bench_blocklist_lookup();
+    bench_teardown();
+
+    return 0;
+}
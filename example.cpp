@@ -8,6 +8,7 @@
  * 4. 运行时动态添加和移除文件监控
  * 5. 不同类型的 task 处理同一个文件
  * 6. 细粒度注销单个 task（不影响其他监听同一文件的 task）
+ * 7. 同一文件的多个 task 共享一次解析结果（parsed<Parser>()）
  *
  * 编译命令：
  * g++ example.cpp -o example -lpthread -std=c++17
@@ -25,12 +26,32 @@
 #include <chrono>
 #include <atomic>
 #include <vector>
+#include <sstream>
 
 #include "hot_loader.h"
 
 // ============================================================
 // Task 类型 1: 配置文件热加载任务
 // ============================================================
+
+// 配置文件的解析结果，按行保存
+struct ConfigLines {
+    std::vector<std::string> lines;
+};
+
+// 解析器类型即解析身份：监控同一文件的所有 ConfigTask 对每个文件版本只解析一次，
+// 并共享同一个不可变结果
+struct ConfigParser {
+    std::shared_ptr<const ConfigLines> operator()(const std::shared_ptr<const FileSnapshot>& content) const {
+        auto config = std::make_shared<ConfigLines>();
+        std::istringstream in(content->data);
+        for (std::string line; std::getline(in, line);) {
+            config->lines.push_back(line);
+        }
+        return config;
+    }
+};
+
 class ConfigTask : public HotLoadTask {
 public:
     ConfigTask(const std::string& file, const std::string& task_name)
@@ -53,8 +74,13 @@ public:
 
 private:
     void load_config() {
-        // 模拟配置加载
-        std::cout << "  -> 配置已重新加载完成" << std::endl;
+        std::shared_ptr<const ConfigLines> config = parsed<ConfigParser>();
+        if (!config) {
+            std::cout << "  -> 无法读取配置文件" << std::endl;
+            return;
+        }
+        std::cout << "  -> 配置已重新加载完成，共 " << config->lines.size() << " 行（解析结果 " << config.get()
+                  << "）" << std::endl;
     }
 
     std::string _task_name;
@@ -265,8 +291,8 @@ void demo_same_class_multiple_instances() {
     std::cout << "\n等待 2 秒后修改文件..." << std::endl;
     std::this_thread::sleep_for(std::chrono::seconds(2));
 
-    // 修改文件，应该触发所有 5 个实例
-    std::cout << "\n>>> 修改 config1.json，应该触发所有 5 个实例" << std::endl;
+    // 修改文件，应该触发所有 5 个实例，它们打印的解析结果地址相同
+    std::cout << "\n>>> 修改 config1.json，应该触发所有 5 个实例（共享一次解析）" << std::endl;
     system("echo 'trigger all instances' > config1.json");
     std::this_thread::sleep_for(std::chrono::milliseconds(500));
 
@@ -0,0 +1,458 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "hot_loader.h"
+
+// Longest-prefix-match table over KeyBits wide unsigned keys, compiled into a
+// poptrie-style layout. The top DirectBits bits index a direct array holding
+// either the result or a node; below that, 6-bit strides where each node is two
+// 64-bit bitmaps and two base offsets, and the children and leaf runs of a
+// node are stored contiguously and addressed with popcount. A lookup touches
+// the direct array, one 24-byte node per further level and a single leaf.
+// Values must be below 2^31.
+template <typename Key, int KeyBits, int DirectBits = 16>
+class LpmTable {
+public:
+    constexpr static int kDirectBits = DirectBits;
+    constexpr static int kStride = 6;
+    constexpr static uint32_t kNoMatch = 0;
+    constexpr static uint32_t kNodeFlag = 1u << 31; // Direct entry refers to a node
+
+    // Collects prefixes, then compiles them in one pass over the sorted list
+    class Builder {
+    public:
+        // Later insertions of the same prefix replace earlier ones
+        void insert(Key prefix, int length, uint32_t value) {
+            Key mask = (length == 0) ? Key(0) : static_cast<Key>(~Key(0) << (KeyBits - length));
+            _prefixes.push_back(Prefix{static_cast<Key>(prefix & mask), length, value,
+                                       static_cast<uint32_t>(_prefixes.size())});
+        }
+
+        size_t size() const {
+            return _prefixes.size();
+        }
+
+        LpmTable build() {
+            std::sort(_prefixes.begin(), _prefixes.end(), [](const Prefix& a, const Prefix& b) {
+                if (a.key != b.key) {
+                    return a.key < b.key;
+                }
+                if (a.length != b.length) {
+                    return a.length < b.length;
+                }
+                return a.order < b.order;
+            });
+
+            LpmTable table;
+
+            // Prefixes up to kDirectBits long are expanded into the direct array
+            table._direct.assign(size_t(1) << kDirectBits, kNoMatch);
+            std::vector<int8_t> length(table._direct.size(), -1);
+            for (const Prefix& p : _prefixes) {
+                if (p.length > kDirectBits) {
+                    continue;
+                }
+
+                size_t span = size_t(1) << (kDirectBits - p.length);
+                size_t first = top(p.key) & ~(span - 1);
+                for (size_t slot = first; slot < first + span; ++slot) {
+                    if (length[slot] <= p.length) {
+                        length[slot] = static_cast<int8_t>(p.length);
+                        table._direct[slot] = p.value;
+                    }
+                }
+            }
+
+            // Longer prefixes sharing the same top bits are contiguous once sorted
+            size_t lo = 0;
+            while (lo < _prefixes.size()) {
+                if (_prefixes[lo].length <= kDirectBits) {
+                    ++lo;
+                    continue;
+                }
+
+                uint32_t slot = top(_prefixes[lo].key);
+                size_t hi = lo + 1;
+                while (hi < _prefixes.size() && top(_prefixes[hi].key) == slot) {
+                    ++hi;
+                }
+
+                size_t position = table._nodes.size();
+                table._nodes.emplace_back();
+                compile(table, lo, hi, kDirectBits, table._direct[slot], position);
+                table._direct[slot] = kNodeFlag | static_cast<uint32_t>(position);
+                lo = hi;
+            }
+
+            table._nodes.shrink_to_fit();
+            table._leaves.shrink_to_fit();
+            return table;
+        }
+
+    private:
+        struct Prefix {
+            Key key;
+            int length;
+            uint32_t value;
+            uint32_t order; // Insertion order, the latest duplicate wins
+        };
+
+        // Compile the node at `position` covering the prefixes in [lo, hi),
+        // which all share their first `offset` bits. Children of the node are
+        // allocated contiguously before recursing into them.
+        void compile(LpmTable& table, size_t lo, size_t hi, int offset, uint32_t inherited, size_t position) {
+            std::array<uint32_t, 64> value;
+            std::array<int, 64> length;
+            value.fill(inherited);   // Leaf pushing: slots inherit the covering prefix
+            length.fill(-1);
+
+            std::array<size_t, 64> child_lo;
+            std::array<size_t, 64> child_hi;
+            uint64_t children = 0;
+
+            for (size_t i = lo; i < hi; ++i) {
+                const Prefix& p = _prefixes[i];
+                int remaining = p.length - offset;
+                if (remaining <= 0) {
+                    continue; // Handled by an ancestor or the direct array
+                }
+
+                uint32_t idx = chunk(p.key, offset);
+                if (remaining > kStride) {
+                    if (!(children & (1ULL << idx))) {
+                        children |= 1ULL << idx;
+                        child_lo[idx] = i;
+                    }
+                    child_hi[idx] = i + 1;
+                    continue;
+                }
+
+                // The prefix covers a run of 2^(stride - remaining) slots
+                uint32_t span = 1u << (kStride - remaining);
+                uint32_t first = idx & ~(span - 1);
+                for (uint32_t slot = first; slot < first + span; ++slot) {
+                    if (length[slot] <= remaining) {
+                        length[slot] = remaining;
+                        value[slot] = p.value;
+                    }
+                }
+            }
+
+            Node node{children, 0, static_cast<uint32_t>(table._leaves.size()),
+                      static_cast<uint32_t>(table._nodes.size())};
+
+            bool has_leaf = false;
+            uint32_t previous = 0;
+            for (uint32_t slot = 0; slot < 64; ++slot) {
+                if (children & (1ULL << slot)) {
+                    continue;
+                }
+                if (!has_leaf || value[slot] != previous) {
+                    node.leafvec |= 1ULL << slot;
+                    table._leaves.push_back(value[slot]);
+                    has_leaf = true;
+                    previous = value[slot];
+                }
+            }
+
+            table._nodes[position] = node;
+            table._nodes.resize(table._nodes.size() + __builtin_popcountll(children));
+
+            size_t child = node.base1;
+            for (uint32_t slot = 0; slot < 64; ++slot) {
+                if (children & (1ULL << slot)) {
+                    compile(table, child_lo[slot], child_hi[slot], offset + kStride, value[slot], child++);
+                }
+            }
+        }
+
+        std::vector<Prefix> _prefixes;
+    };
+
+    uint32_t lookup(Key key) const {
+        uint32_t entry = _direct[top(key)];
+        if (!(entry & kNodeFlag)) {
+            return entry;
+        }
+
+        const Node* node = &_nodes[entry & ~kNodeFlag];
+        int offset = kDirectBits;
+        while (true) {
+            uint64_t bit = 1ULL << chunk(key, offset);
+            uint64_t mask = (bit << 1) - 1; // Wraps to all ones for the last slot
+            if (node->vector & bit) {
+                node = &_nodes[node->base1 + __builtin_popcountll(node->vector & mask) - 1];
+                offset += kStride;
+            } else {
+                return _leaves[node->base0 + __builtin_popcountll(node->leafvec & mask) - 1];
+            }
+        }
+    }
+
+    size_t memory_usage() const {
+        return (_direct.size() + _leaves.size()) * sizeof(uint32_t) + _nodes.size() * sizeof(Node);
+    }
+
+private:
+    struct Node {
+        uint64_t vector;  // Slots that point to a child node
+        uint64_t leafvec; // Slots where a new run of leaf values starts
+        uint32_t base0;   // Index of the first leaf of this node
+        uint32_t base1;   // Index of the first child of this node
+    };
+
+    // Bits [offset, offset + stride) of the key, zero padded past its end
+    static uint32_t chunk(Key key, int offset) {
+        return static_cast<uint32_t>(static_cast<Key>(key << offset) >> (KeyBits - kStride));
+    }
+
+    static uint32_t top(Key key) {
+        return static_cast<uint32_t>(key >> (KeyBits - kDirectBits));
+    }
+
+    std::vector<uint32_t> _direct; // Result or kNodeFlag | node index, by top kDirectBits bits
+    std::vector<Node> _nodes;
+    std::vector<uint32_t> _leaves;
+};
+
+// Compiled allow/deny list of IPv4 and IPv6 CIDRs.
+class HotIpAcl {
+public:
+    enum Action : uint32_t {
+        NO_MATCH = 0, // No rule covers the address
+        ALLOW = 1,
+        DENY = 2
+    };
+
+    // 18 direct bits let /24 routes end on the first node level
+    using V4Table = LpmTable<uint32_t, 32, 18>;
+    using V6Table = LpmTable<unsigned __int128, 128, 16>;
+
+    Action lookup(const in_addr& addr) const {
+        return static_cast<Action>(_v4.lookup(ntohl(addr.s_addr)));
+    }
+
+    Action lookup(const in6_addr& addr) const {
+        return static_cast<Action>(_v6.lookup(to_key(addr)));
+    }
+
+    // Textual IPv4 or IPv6 address, NO_MATCH if it does not parse
+    Action lookup(const std::string& ip) const {
+        in_addr v4;
+        if (inet_pton(AF_INET, ip.c_str(), &v4) == 1) {
+            return lookup(v4);
+        }
+
+        in6_addr v6;
+        if (inet_pton(AF_INET6, ip.c_str(), &v6) == 1) {
+            return lookup(v6);
+        }
+
+        return NO_MATCH;
+    }
+
+    size_t rule_count() const {
+        return _rule_count;
+    }
+
+    size_t memory_usage() const {
+        return _v4.memory_usage() + _v6.memory_usage();
+    }
+
+    // Parse one rule per line: "<cidr> [allow|deny]", '#' starts a comment and
+    // a bare address is a host route. Returns null and sets error_line (1-based)
+    // on the first malformed line.
+    static std::shared_ptr<const HotIpAcl> compile(const std::string& text, Action default_action,
+                                                   size_t* error_line = nullptr) {
+        V4Table::Builder v4;
+        V6Table::Builder v6;
+        size_t rules = 0;
+        size_t line_no = 0;
+
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = text.find('\n', pos);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            std::string line = text.substr(pos, end - pos);
+            pos = end + 1;
+            ++line_no;
+
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) {
+                line.erase(comment);
+            }
+
+            std::vector<std::string> fields = split(line);
+            if (fields.empty()) {
+                continue;
+            }
+
+            Action action = default_action;
+            if (fields.size() == 2 && fields[1] == "allow") {
+                action = ALLOW;
+            } else if (fields.size() == 2 && fields[1] == "deny") {
+                action = DENY;
+            } else if (fields.size() != 1) {
+                return fail(error_line, line_no);
+            }
+
+            if (!add_rule(fields[0], action, v4, v6)) {
+                return fail(error_line, line_no);
+            }
+            ++rules;
+        }
+
+        auto acl = std::make_shared<HotIpAcl>();
+        acl->_v4 = v4.build();
+        acl->_v6 = v6.build();
+        acl->_rule_count = rules;
+        return acl;
+    }
+
+private:
+    static unsigned __int128 to_key(const in6_addr& addr) {
+        unsigned __int128 key = 0;
+        for (int i = 0; i < 16; ++i) {
+            key = (key << 8) | addr.s6_addr[i];
+        }
+        return key;
+    }
+
+    static std::vector<std::string> split(const std::string& line) {
+        std::vector<std::string> fields;
+        size_t pos = 0;
+        while (true) {
+            size_t begin = line.find_first_not_of(" \t\r", pos);
+            if (begin == std::string::npos) {
+                break;
+            }
+            size_t end = line.find_first_of(" \t\r", begin);
+            fields.push_back(line.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+            if (end == std::string::npos) {
+                break;
+            }
+            pos = end;
+        }
+        return fields;
+    }
+
+    static bool add_rule(const std::string& cidr, Action action, V4Table::Builder& v4, V6Table::Builder& v6) {
+        size_t slash = cidr.find('/');
+        std::string address = cidr.substr(0, slash);
+
+        // Decimal digits only, no sign or whitespace, range checked before
+        // narrowing so an out of range length cannot wrap into a valid one
+        bool has_length = (slash != std::string::npos);
+        int length = 0;
+        if (has_length) {
+            std::string digits = cidr.substr(slash + 1);
+            if (digits.empty() || digits.size() > 3) {
+                return false;
+            }
+            for (char c : digits) {
+                if (c < '0' || c > '9') {
+                    return false;
+                }
+                length = length * 10 + (c - '0');
+            }
+        }
+
+        in_addr addr4;
+        if (inet_pton(AF_INET, address.c_str(), &addr4) == 1) {
+            length = has_length ? length : 32;
+            if (length > 32) {
+                return false;
+            }
+            v4.insert(ntohl(addr4.s_addr), length, action);
+            return true;
+        }
+
+        in6_addr addr6;
+        if (inet_pton(AF_INET6, address.c_str(), &addr6) == 1) {
+            length = has_length ? length : 128;
+            if (length > 128) {
+                return false;
+            }
+            v6.insert(to_key(addr6), length, action);
+            return true;
+        }
+
+        return false;
+    }
+
+    static std::shared_ptr<const HotIpAcl> fail(size_t* error_line, size_t line_no) {
+        if (error_line) {
+            *error_line = line_no;
+        }
+        return nullptr;
+    }
+
+    V4Table _v4 = V4Table::Builder().build();
+    V6Table _v6 = V6Table::Builder().build();
+    size_t _rule_count = 0;
+};
+
+// Watches an IP allow/deny list and republishes it compiled into LPM tables
+// on every change. Compilation runs on the HotLoader thread; request threads
+// only load the current snapshot. A file with a malformed line is rejected
+// as a whole and the previous version stays active.
+class HotIpAclTask : public HotLoadTask {
+public:
+    HotIpAclTask(const std::string& file, HotIpAcl::Action default_action = HotIpAcl::DENY)
+        : HotLoadTask(file), _default_action(default_action) {
+        load();
+    }
+
+    // Current compiled ACL, keep it for a batch of lookups
+    std::shared_ptr<const HotIpAcl> acl() const {
+        return _acl.load();
+    }
+
+    template <typename Address>
+    HotIpAcl::Action lookup(const Address& addr) const {
+        return _acl.load()->lookup(addr);
+    }
+
+    // 1-based line of the last rejected version, 0 if the last load succeeded
+    size_t error_line() const {
+        return _error_line.load();
+    }
+
+    void on_reload() override {
+        load();
+    }
+
+private:
+    void load() {
+        std::shared_ptr<const FileSnapshot> content = snapshot();
+        std::shared_ptr<const HotIpAcl> acl;
+        if (content) {
+            size_t error_line = 0;
+            acl = HotIpAcl::compile(content->data, _default_action, &error_line);
+            _error_line.store(error_line);
+        }
+
+        if (acl) {
+            _acl.publish(std::move(acl));
+        } else if (!_acl.load()) {
+            _acl.publish(std::make_shared<const HotIpAcl>()); // Never leave readers without a table
+        }
+    }
+
+private:
+    HotIpAcl::Action _default_action;
+    HotValue<HotIpAcl> _acl;
+    std::atomic<size_t> _error_line{0};
+};
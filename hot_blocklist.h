@@ -0,0 +1,308 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cmath>
+
+#include "hot_loader.h"
+
+// Static string set stored as a minimal perfect hash (PTHash style: keys are
+// hashed into skewed buckets and each bucket stores the pilot that places its
+// keys into free slots) plus one fingerprint per key to reject non-members.
+// Keys themselves are not stored: a lookup reads one pilot and one
+// fingerprint, and a key costs about sizeof(Fingerprint) + 1 bytes. A
+// non-member is wrongly reported present with probability 2^-bits(Fingerprint).
+template <typename Fingerprint = uint32_t>
+class PerfectHashSet {
+public:
+    constexpr static double kLoadFactor = 0.98;   // Keys per slot before remapping to [0, n)
+    constexpr static double kBucketsPerKey = 6.0; // Times n / log2(n)
+    constexpr static uint32_t kMaxPilot = 0xffff;
+    constexpr static int kMaxAttempts = 16;       // Seeds tried before giving up
+
+    // Build over the given keys, duplicates are ignored. Returns null if no
+    // seed could place all keys (only possible on adversarial input).
+    static std::shared_ptr<const PerfectHashSet> build(std::vector<std::string_view> keys, uint64_t seed = 0) {
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+            auto set = std::make_shared<PerfectHashSet>();
+            if (set->try_build(keys, seed + static_cast<uint64_t>(attempt) * 0x9e3779b97f4a7c15ULL)) {
+                return set;
+            }
+        }
+        return nullptr;
+    }
+
+    bool contains(std::string_view key) const {
+        if (_size == 0) {
+            return false;
+        }
+
+        uint64_t h = hot_hash64(key.data(), key.size(), _seed);
+        uint64_t pos = position(h, _pilots[bucket(h)]);
+        if (pos >= _size) {
+            pos = _remap[pos - _size];
+        }
+        return _fingerprints[pos] == fingerprint(h);
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    size_t memory_usage() const {
+        return _pilots.size() * sizeof(uint16_t) + _fingerprints.size() * sizeof(Fingerprint) +
+               _remap.size() * sizeof(uint32_t);
+    }
+
+private:
+    bool try_build(const std::vector<std::string_view>& keys, uint64_t seed) {
+        _seed = seed;
+        _size = keys.size();
+        if (_size == 0) {
+            return true;
+        }
+
+        _slots = static_cast<uint64_t>(static_cast<double>(_size) / kLoadFactor) + 1;
+        double log_n = std::max(1.0, std::log2(static_cast<double>(_size)));
+        _buckets = std::max<uint64_t>(2, static_cast<uint64_t>(kBucketsPerKey * _size / log_n));
+        _dense_buckets = std::max<uint64_t>(1, _buckets * 3 / 10);
+
+        std::vector<uint64_t> hashes(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            hashes[i] = hot_hash64(keys[i].data(), keys[i].size(), seed);
+        }
+
+        // Order keys by bucket, then place the largest buckets first
+        std::vector<std::pair<uint64_t, uint64_t>> by_bucket; // Bucket, hash
+        by_bucket.reserve(hashes.size());
+        for (uint64_t h : hashes) {
+            by_bucket.emplace_back(bucket(h), h);
+        }
+        std::sort(by_bucket.begin(), by_bucket.end());
+        for (size_t i = 1; i < by_bucket.size(); ++i) {
+            if (by_bucket[i] == by_bucket[i - 1]) {
+                return false; // Two keys share the 64-bit hash, try another seed
+            }
+        }
+
+        std::vector<std::pair<size_t, size_t>> ranges; // Begin, end in by_bucket
+        for (size_t begin = 0; begin < by_bucket.size();) {
+            size_t end = begin + 1;
+            while (end < by_bucket.size() && by_bucket[end].first == by_bucket[begin].first) {
+                ++end;
+            }
+            ranges.emplace_back(begin, end);
+            begin = end;
+        }
+        std::stable_sort(ranges.begin(), ranges.end(), [](const auto& a, const auto& b) {
+            return a.second - a.first > b.second - b.first;
+        });
+
+        _pilots.assign(_buckets, 0);
+        std::vector<uint64_t> taken((_slots + 63) / 64, 0);
+        std::vector<uint64_t> positions;
+
+        for (const auto& [begin, end] : ranges) {
+            bool placed = false;
+            for (uint32_t pilot = 0; pilot <= kMaxPilot && !placed; ++pilot) {
+                positions.clear();
+                placed = true;
+                for (size_t i = begin; i < end; ++i) {
+                    uint64_t pos = position(by_bucket[i].second, pilot);
+                    if ((taken[pos / 64] >> (pos % 64)) & 1 ||
+                        std::find(positions.begin(), positions.end(), pos) != positions.end()) {
+                        placed = false;
+                        break;
+                    }
+                    positions.push_back(pos);
+                }
+
+                if (placed) {
+                    _pilots[by_bucket[begin].first] = static_cast<uint16_t>(pilot);
+                    for (uint64_t pos : positions) {
+                        taken[pos / 64] |= 1ULL << (pos % 64);
+                    }
+                }
+            }
+
+            if (!placed) {
+                return false; // Try another seed
+            }
+        }
+
+        // Slots past n are remapped onto the free slots below n, making the hash minimal
+        _remap.assign(_slots - _size, 0);
+        uint64_t free_slot = 0;
+        for (uint64_t pos = _size; pos < _slots; ++pos) {
+            if (!((taken[pos / 64] >> (pos % 64)) & 1)) {
+                continue;
+            }
+            while ((taken[free_slot / 64] >> (free_slot % 64)) & 1) {
+                ++free_slot;
+            }
+            _remap[pos - _size] = static_cast<uint32_t>(free_slot++);
+        }
+
+        _fingerprints.assign(_size, 0);
+        for (uint64_t h : hashes) {
+            uint64_t pos = position(h, _pilots[bucket(h)]);
+            if (pos >= _size) {
+                pos = _remap[pos - _size];
+            }
+            _fingerprints[pos] = fingerprint(h);
+        }
+
+        return true;
+    }
+
+    // 60% of the keys go to the first 30% of the buckets, which keeps the
+    // pilot search short for the small buckets placed last
+    uint64_t bucket(uint64_t h) const {
+        constexpr uint64_t kDenseThreshold = 0x99999999ULL; // 0.6 * 2^32
+        uint64_t select = h & 0xffffffffULL;
+        uint64_t range = h >> 32;
+        if (select < kDenseThreshold) {
+            return (range * _dense_buckets) >> 32;
+        }
+        return _dense_buckets + ((range * (_buckets - _dense_buckets)) >> 32);
+    }
+
+    // Keys of one bucket share the high bits of their hash, so the pilot is
+    // mixed in with a multiply rather than a plain xor
+    uint64_t position(uint64_t h, uint32_t pilot) const {
+        uint64_t mixed = hot_mix64(h ^ (pilot + _seed), 0x9e3779b97f4a7c15ULL);
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(mixed) * _slots) >> 64);
+    }
+
+    static Fingerprint fingerprint(uint64_t h) {
+        return static_cast<Fingerprint>(hot_mix64(h, 0x2545f4914f6cdd1dULL));
+    }
+
+private:
+    uint64_t _seed = 0;
+    uint64_t _size = 0;          // Number of keys, also the number of fingerprint slots
+    uint64_t _slots = 0;         // Slots addressed by the pilots, slightly more than _size
+    uint64_t _buckets = 0;
+    uint64_t _dense_buckets = 0;
+    std::vector<uint16_t> _pilots;
+    std::vector<Fingerprint> _fingerprints;
+    std::vector<uint32_t> _remap; // Target below _size of each used slot past _size
+};
+
+// Watches a blocklist file (one entry per line, '#' comments) and republishes
+// it as a PerfectHashSet on every change. Parsing and building run on a
+// builder thread owned by the task, so a large list does not hold up the
+// dispatch of other tasks; a change arriving during a build supersedes any
+// change still waiting.
+class HotBlocklistTask : public HotLoadTask {
+public:
+    using Set = PerfectHashSet<uint32_t>;
+
+    explicit HotBlocklistTask(const std::string& file)
+        : HotLoadTask(file) {
+        std::shared_ptr<const FileSnapshot> content = snapshot();
+        std::shared_ptr<const Set> set = content ? compile(content->data) : nullptr;
+        _set.publish(set ? set : Set::build({}));
+
+        _builder = std::thread(&HotBlocklistTask::build_loop, this);
+    }
+
+    ~HotBlocklistTask() override {
+        {
+            std::lock_guard<std::mutex> lock(_build_mutex);
+            _stopping = true;
+        }
+        _build_cond.notify_one();
+        _builder.join();
+    }
+
+    // Current set, keep it for a batch of lookups
+    std::shared_ptr<const Set> set() const {
+        return _set.load();
+    }
+
+    bool contains(std::string_view key) const {
+        return _set.load()->contains(key);
+    }
+
+    // Number of sets published so far, including the initial one
+    uint64_t generation() const {
+        return _set.version();
+    }
+
+    void on_reload() override {
+        std::shared_ptr<const FileSnapshot> content = snapshot();
+        if (!content) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_build_mutex);
+            _pending = std::move(content);
+        }
+        _build_cond.notify_one();
+    }
+
+    static std::shared_ptr<const Set> compile(const std::string& text) {
+        std::vector<std::string_view> keys;
+        std::string_view rest(text);
+        while (!rest.empty()) {
+            size_t end = rest.find('\n');
+            std::string_view line = rest.substr(0, end);
+            rest = (end == std::string_view::npos) ? std::string_view() : rest.substr(end + 1);
+
+            size_t comment = line.find('#');
+            if (comment != std::string_view::npos) {
+                line = line.substr(0, comment);
+            }
+
+            size_t begin = line.find_first_not_of(" \t\r");
+            if (begin == std::string_view::npos) {
+                continue;
+            }
+            size_t last = line.find_last_not_of(" \t\r");
+            keys.push_back(line.substr(begin, last - begin + 1));
+        }
+
+        return Set::build(std::move(keys));
+    }
+
+private:
+    void build_loop() {
+        std::unique_lock<std::mutex> lock(_build_mutex);
+        while (true) {
+            _build_cond.wait(lock, [this] { return _stopping || _pending; });
+            if (_stopping) {
+                return;
+            }
+
+            std::shared_ptr<const FileSnapshot> content = std::move(_pending);
+            _pending.reset();
+
+            lock.unlock();
+            std::shared_ptr<const Set> set = compile(content->data);
+            if (set) {
+                _set.publish(std::move(set)); // Keep the previous set if building failed
+            }
+            lock.lock();
+        }
+    }
+
+private:
+    HotValue<Set> _set;
+    std::mutex _build_mutex;
+    std::condition_variable _build_cond;
+    std::shared_ptr<const FileSnapshot> _pending; // Latest content waiting to be built
+    bool _stopping = false;
+    std::thread _builder;
+};
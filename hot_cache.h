@@ -0,0 +1,313 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+
+#include "hot_loader.h"
+
+// Counters of a FileCache, updated with relaxed atomics
+struct FileCacheMetrics {
+    std::atomic<uint64_t> hits{0};          // Served from memory, including refreshed entries
+    std::atomic<uint64_t> misses{0};        // Path was not resident and had to be read
+    std::atomic<uint64_t> negative_hits{0}; // Missing path answered from the negative cache
+    std::atomic<uint64_t> evictions{0};     // Entries dropped to stay within the capacity
+    std::atomic<uint64_t> invalidations{0}; // Resident entries whose file changed or went away
+};
+
+// Memory-bounded cache of file contents or objects parsed from them. Every
+// resident entry is watched through the HotLoader and invalidated exactly
+// when its file changes or is removed, so a hit never touches the file
+// system: it is one shared lock and a hash lookup. Entries are evicted in
+// CLOCK order once the charged size exceeds the capacity.
+//
+// Missing paths cannot be watched, they are cached as negative entries for
+// a short TTL instead. Keys are the paths as passed to get(), two spellings
+// of one file are two entries.
+template <typename T = std::string>
+class FileCache {
+public:
+    using Value = std::shared_ptr<const T>;
+
+    // Builds the cached object from the file content, null rejects the file
+    using Parser = std::function<Value(const std::string& path, const std::string& data)>;
+
+    // Bytes an object is charged against the capacity
+    using Charge = std::function<size_t(const T& value)>;
+
+    explicit FileCache(size_t capacity,
+                       Parser parser = default_parser(),
+                       Charge charge = default_charge(),
+                       std::chrono::milliseconds negative_ttl = std::chrono::milliseconds(1000),
+                       HotLoader& loader = HotLoader::instance())
+        : _capacity(capacity), _parser(std::move(parser)), _charge(std::move(charge)),
+          _negative_ttl(negative_ttl), _loader(loader) {}
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    ~FileCache() {
+        clear();
+    }
+
+    // Cached object for a path, null if the file is missing or was rejected
+    // by the parser. Entries are only kept while the HotLoader is running,
+    // nothing else invalidates them: without it every call parses the file
+    // again, and entries cached before stop() are dropped.
+    Value get(const std::string& path) {
+        if (!_loader.running()) {
+            clear();
+            _metrics.misses.fetch_add(1, std::memory_order_relaxed);
+            return insert(path);
+        }
+
+        std::shared_ptr<Entry> entry;
+        {
+            std::shared_lock<std::shared_mutex> lock(_mutex);
+            auto it = _index.find(path);
+            if (it != _index.end()) {
+                entry = *it->second;
+            }
+        }
+
+        if (entry) {
+            entry->referenced.store(true, std::memory_order_relaxed);
+
+            if (!entry->task) {
+                if (Clock::now() < entry->expires) {
+                    _metrics.negative_hits.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+            } else {
+                if (entry->task->stale.load(std::memory_order_acquire)) {
+                    refresh(*entry);
+                }
+                _metrics.hits.fetch_add(1, std::memory_order_relaxed);
+                return std::atomic_load(&entry->value);
+            }
+        }
+
+        _metrics.misses.fetch_add(1, std::memory_order_relaxed);
+        return insert(path);
+    }
+
+    // Drop every entry and its watch
+    void clear() {
+        std::list<std::shared_ptr<Entry>> entries;
+        {
+            std::unique_lock<std::shared_mutex> lock(_mutex);
+            entries.swap(_ring);
+            _index.clear();
+            _hand = _ring.end();
+            _usage = 0;
+        }
+        // Watches are released here, outside of the cache lock
+    }
+
+    const FileCacheMetrics& metrics() const {
+        return _metrics;
+    }
+
+    // Bytes currently charged against the capacity
+    size_t memory_usage() const {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        return _usage;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        return _ring.size();
+    }
+
+    static Parser default_parser() {
+        if constexpr (std::is_constructible<T, const std::string&>::value) {
+            return [](const std::string&, const std::string& data) { return std::make_shared<const T>(data); };
+        } else {
+            return nullptr; // Must be provided for other types
+        }
+    }
+
+    static Charge default_charge() {
+        if constexpr (std::is_same<T, std::string>::value) {
+            return [](const std::string& value) { return value.size(); };
+        } else {
+            return [](const T&) { return sizeof(T); };
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    constexpr static size_t kEntryOverhead = 128; // Rough bookkeeping cost per entry
+
+    // Watch of one resident file, invalidates its entry from the loader thread
+    class EntryTask : public HotLoadTask {
+    public:
+        EntryTask(const std::string& file, FileCacheMetrics& metrics)
+            : HotLoadTask(file), _metrics(metrics) {}
+
+        void on_reload() override {
+            invalidate();
+        }
+
+        void on_remove() override {
+            invalidate();
+        }
+
+        std::atomic<bool> stale{false};
+
+    private:
+        void invalidate() {
+            if (!stale.exchange(true, std::memory_order_acq_rel)) {
+                _metrics.invalidations.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        FileCacheMetrics& _metrics;
+    };
+
+    struct Entry {
+        explicit Entry(HotLoader& loader)
+            : loader(loader) {}
+
+        ~Entry() {
+            if (task) {
+                loader.unregister_task(task.get());
+            }
+        }
+
+        HotLoader& loader;
+        std::string path;
+        std::unique_ptr<EntryTask> task; // Null for a negative entry
+        Value value;                     // Accessed with atomic_load/atomic_store
+        size_t charge = 0;
+        Clock::time_point expires;       // Negative entries only
+        std::atomic<bool> referenced{true};
+        std::mutex refresh_mutex;
+    };
+
+    Value parse(const std::string& path, const std::shared_ptr<const FileSnapshot>& content) {
+        if (!content || !_parser) {
+            return nullptr;
+        }
+        return _parser(path, content->data);
+    }
+
+    size_t charge_of(const std::string& path, const Value& value) {
+        return kEntryOverhead + path.size() + (value ? _charge(*value) : 0);
+    }
+
+    // Read the new content of an invalidated entry, one thread does the work
+    // and the others wait for it
+    void refresh(Entry& entry) {
+        std::lock_guard<std::mutex> lock(entry.refresh_mutex);
+        if (!entry.task->stale.exchange(false, std::memory_order_acq_rel)) {
+            return; // Refreshed by another thread meanwhile
+        }
+
+        Value value = parse(entry.path, entry.task->snapshot());
+        std::atomic_store(&entry.value, value);
+
+        std::list<std::shared_ptr<Entry>> evicted;
+        {
+            std::unique_lock<std::shared_mutex> cache_lock(_mutex);
+            auto it = _index.find(entry.path);
+            if (it == _index.end() || it->second->get() != &entry) {
+                return; // Evicted meanwhile, no longer charged
+            }
+
+            size_t charge = charge_of(entry.path, value);
+            _usage = _usage - entry.charge + charge;
+            entry.charge = charge;
+            evict(evicted);
+        }
+    }
+
+    Value insert(const std::string& path) {
+        auto entry = std::make_shared<Entry>(_loader);
+        entry->path = path;
+
+        auto task = std::make_unique<EntryTask>(path, _metrics);
+        if (!task->watch_file().empty() && _loader.running() &&
+            _loader.register_task(task.get(), HotLoader::DOESNT_OWN_TASK) == 0) {
+            entry->task = std::move(task);
+            entry->value = parse(path, entry->task->snapshot()); // Changes from now on mark it stale
+        } else if (FileFingerprint::of(path).valid()) {
+            // Exists but cannot be watched (e.g. loader not running), serve it uncached
+            return parse(path, FileSnapshot::read(path, 0));
+        } else {
+            entry->expires = Clock::now() + _negative_ttl;
+        }
+        entry->charge = charge_of(path, entry->value);
+        Value value = entry->value;
+
+        std::list<std::shared_ptr<Entry>> evicted; // Released after the lock is dropped
+        {
+            std::unique_lock<std::shared_mutex> lock(_mutex);
+            auto it = _index.find(path);
+            if (it != _index.end()) {
+                // Replaces a concurrent insert or an expired negative entry
+                _usage -= (*it->second)->charge;
+                evicted.push_back(std::move(*it->second));
+                if (_hand == it->second) {
+                    ++_hand;
+                }
+                _ring.erase(it->second);
+                _index.erase(it);
+            }
+
+            // New entries go right behind the hand, the last place it visits
+            auto pos = _ring.insert(_hand, entry);
+            _index.emplace(path, pos);
+            _usage += entry->charge;
+            evict(evicted);
+        }
+
+        return value;
+    }
+
+    // Advance the clock hand until the usage fits, giving referenced entries
+    // a second chance. Caller must hold _mutex exclusively.
+    void evict(std::list<std::shared_ptr<Entry>>& evicted) {
+        while (_usage > _capacity && !_ring.empty()) {
+            if (_hand == _ring.end()) {
+                _hand = _ring.begin();
+            }
+
+            Entry& entry = **_hand;
+            if (entry.referenced.exchange(false, std::memory_order_relaxed) && _ring.size() > 1) {
+                ++_hand;
+                continue;
+            }
+
+            _usage -= entry.charge;
+            _index.erase(entry.path);
+            evicted.push_back(std::move(*_hand));
+            _hand = _ring.erase(_hand);
+            _metrics.evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    const size_t _capacity;
+    const Parser _parser;
+    const Charge _charge;
+    const std::chrono::milliseconds _negative_ttl;
+    HotLoader& _loader;
+
+    mutable std::shared_mutex _mutex; // Guards the ring, the index and the usage
+    std::list<std::shared_ptr<Entry>> _ring;
+    typename std::list<std::shared_ptr<Entry>>::iterator _hand = _ring.end();
+    std::unordered_map<std::string, typename std::list<std::shared_ptr<Entry>>::iterator> _index;
+    size_t _usage = 0;
+
+    FileCacheMetrics _metrics;
+};
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+#include <cinttypes>
+#include <type_traits>
+
+#include "hot_loader.h"
+
+// Dataset made of shard files listed in a manifest, switched atomically.
+//
+// Only the manifest is watched; producers write the shards first and the
+// manifest last. The manifest has one "<shard> <size> <hash>" line per shard
+// ('#' comments), where <shard> is relative to the manifest's directory and
+// <hash> is checksum() of the shard content. On every manifest change all
+// shards are checked and parsed in parallel; the new version is published
+// as one generation only if every shard exists and verifies, otherwise the
+// previous version stays and last_error() tells why. Shards whose name,
+// size and hash did not change are taken over from the previous version
+// without being read again.
+template <typename Shard = std::string>
+class HotDatasetTask : public HotLoadTask {
+public:
+    struct Dataset {
+        uint64_t generation = 0;
+        std::vector<std::string> names;                 // Shard names in manifest order
+        std::vector<uint64_t> sizes;
+        std::vector<uint64_t> hashes;
+        std::vector<std::shared_ptr<const Shard>> shards;
+
+        // Shard by manifest name, null if not part of this version
+        std::shared_ptr<const Shard> find(const std::string& name) const {
+            auto it = std::find(names.begin(), names.end(), name);
+            return (it == names.end()) ? nullptr : shards[static_cast<size_t>(it - names.begin())];
+        }
+    };
+
+    // Builds a shard from its verified content, null rejects the whole version
+    using Parser = std::function<std::shared_ptr<const Shard>(const std::string& name, std::string data)>;
+
+    explicit HotDatasetTask(const std::string& manifest, Parser parser = default_parser(), size_t threads = 0)
+        : HotLoadTask(manifest), _parser(std::move(parser)),
+          _threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {
+        if (!load()) {
+            _dataset.publish(std::make_shared<const Dataset>()); // Readers never see null
+        }
+    }
+
+    // Current version, safe to call from any thread
+    std::shared_ptr<const Dataset> dataset() const {
+        return _dataset.load();
+    }
+
+    // Number of versions published so far
+    uint64_t generation() const {
+        return _generation.load(std::memory_order_acquire);
+    }
+
+    // Why the last manifest change was rejected, empty if it was published
+    std::string last_error() const {
+        std::lock_guard<std::mutex> lock(_error_mutex);
+        return _last_error;
+    }
+
+    void on_reload() override {
+        load();
+    }
+
+    // Hash to put in the manifest for a shard content
+    static uint64_t checksum(const std::string& data) {
+        return hot_hash64(data.data(), data.size());
+    }
+
+    static Parser default_parser() {
+        if constexpr (std::is_constructible<Shard, std::string&&>::value) {
+            return [](const std::string&, std::string data) { return std::make_shared<const Shard>(std::move(data)); };
+        } else {
+            return nullptr; // Must be provided for other types
+        }
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        uint64_t size = 0;
+        uint64_t hash = 0;
+    };
+
+    bool load() {
+        std::shared_ptr<const FileSnapshot> manifest = snapshot();
+        if (!manifest) {
+            return fail("cannot read manifest");
+        }
+
+        std::vector<Entry> entries;
+        std::string error;
+        if (!parse_manifest(manifest->data, entries, error)) {
+            return fail(error);
+        }
+
+        auto next = std::make_shared<Dataset>();
+        next->names.reserve(entries.size());
+        for (const auto& entry : entries) {
+            next->names.push_back(entry.name);
+            next->sizes.push_back(entry.size);
+            next->hashes.push_back(entry.hash);
+        }
+        next->shards.resize(entries.size());
+
+        // Reuse shards the previous version already verified
+        std::shared_ptr<const Dataset> previous = _dataset.load();
+        std::vector<size_t> pending;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (previous) {
+                auto it = std::find(previous->names.begin(), previous->names.end(), entries[i].name);
+                size_t j = static_cast<size_t>(it - previous->names.begin());
+                if (it != previous->names.end() && previous->sizes[j] == entries[i].size &&
+                    previous->hashes[j] == entries[i].hash) {
+                    next->shards[i] = previous->shards[j];
+                    continue;
+                }
+            }
+            pending.push_back(i);
+        }
+
+        // Cheap size check of every shard before reading any of them
+        std::filesystem::path base = std::filesystem::path(watch_file()).parent_path();
+        for (size_t i : pending) {
+            FileFingerprint fp = FileFingerprint::of((base / entries[i].name).string());
+            if (!fp.valid() || static_cast<uint64_t>(fp.size) != entries[i].size) {
+                return fail(entries[i].name + ": " + (fp.valid() ? "size mismatch" : "missing"));
+            }
+        }
+
+        // Read, hash and parse the remaining shards in parallel
+        std::atomic<size_t> cursor{0};
+        std::atomic<bool> failed{false};
+        std::mutex error_mutex;
+        auto worker = [&]() {
+            while (!failed.load(std::memory_order_relaxed)) {
+                size_t k = cursor.fetch_add(1, std::memory_order_relaxed);
+                if (k >= pending.size()) {
+                    return;
+                }
+
+                const Entry& entry = entries[pending[k]];
+                std::string shard_error;
+                std::shared_ptr<const Shard> shard;
+                try {
+                    shard = load_shard(base / entry.name, entry, shard_error);
+                } catch (const std::exception& e) {
+                    shard_error = std::string("parser failed: ") + e.what(); // Fails this version only
+                } catch (...) {
+                    shard_error = "parser failed";
+                }
+                if (!shard) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!failed.exchange(true)) {
+                        error = entry.name + ": " + shard_error;
+                    }
+                    return;
+                }
+                next->shards[pending[k]] = std::move(shard);
+            }
+        };
+
+        size_t thread_count = std::min(_threads, pending.size());
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < thread_count; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker(); // The loader thread takes a share too
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        if (failed.load()) {
+            return fail(error);
+        }
+
+        next->generation = _generation.load(std::memory_order_relaxed) + 1;
+        _dataset.publish(std::move(next));
+        _generation.fetch_add(1, std::memory_order_release);
+
+        std::lock_guard<std::mutex> lock(_error_mutex);
+        _last_error.clear();
+        return true;
+    }
+
+    std::shared_ptr<const Shard> load_shard(const std::filesystem::path& file, const Entry& entry,
+                                            std::string& error) {
+        // Read into a string of our own, it is moved into the parser
+        std::string data;
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        bool read = (fd >= 0) && FileSnapshot::read_all(fd, data);
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!read) {
+            error = "cannot read";
+            return nullptr;
+        }
+        if (data.size() != entry.size) {
+            error = "size mismatch";
+            return nullptr;
+        }
+        if (checksum(data) != entry.hash) {
+            error = "hash mismatch";
+            return nullptr;
+        }
+
+        std::shared_ptr<const Shard> shard = _parser ? _parser(entry.name, std::move(data)) : nullptr;
+        if (!shard) {
+            error = "rejected by parser";
+        }
+        return shard;
+    }
+
+    static bool parse_manifest(const std::string& text, std::vector<Entry>& entries, std::string& error) {
+        size_t pos = 0;
+        size_t line_number = 0;
+        while (pos < text.size()) {
+            size_t end = text.find('\n', pos);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            std::string line = text.substr(pos, end - pos);
+            pos = end + 1;
+            ++line_number;
+
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) {
+                line.erase(comment);
+            }
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+
+            char name[4096];
+            Entry entry;
+            if (sscanf(line.c_str(), "%4095s %" SCNu64 " %" SCNx64, name, &entry.size, &entry.hash) != 3) {
+                error = "malformed manifest line " + std::to_string(line_number);
+                return false;
+            }
+            entry.name = name;
+            entries.push_back(std::move(entry));
+        }
+        return true;
+    }
+
+    bool fail(const std::string& error) {
+        std::lock_guard<std::mutex> lock(_error_mutex);
+        _last_error = error;
+        return false;
+    }
+
+private:
+    const Parser _parser;
+    const size_t _threads;
+    HotValue<Dataset> _dataset;
+    std::atomic<uint64_t> _generation{0};
+    mutable std::mutex _error_mutex;
+    std::string _last_error;
+};
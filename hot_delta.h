@@ -0,0 +1,224 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "hot_loader.h"
+
+// Block checksum for delta detection. Four independent hot_mix64 lanes each
+// take 16 bytes of every 64-byte stride, so the multiplications do not wait
+// on each other and the loop runs several lanes per cycle, unlike the single
+// dependency chain of hot_hash64.
+inline uint64_t hot_block_hash(const void* data, size_t len, uint64_t seed = 0) {
+    constexpr uint64_t k0 = 0xa0761d6478bd642fULL;
+    constexpr uint64_t k1 = 0xe7037ed1a0b428dbULL;
+
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t lanes[4] = {seed ^ k0, seed ^ k1, ~seed ^ k0, ~seed ^ k1};
+    size_t total = len;
+
+    while (len >= 64) {
+        for (int lane = 0; lane < 4; ++lane) {
+            uint64_t a = 0;
+            uint64_t b = 0;
+            memcpy(&a, p + lane * 16, 8);
+            memcpy(&b, p + lane * 16 + 8, 8);
+            lanes[lane] = hot_mix64(a ^ k1 ^ lanes[lane], b ^ k0);
+        }
+        p += 64;
+        len -= 64;
+    }
+
+    uint64_t h = hot_mix64(lanes[0] ^ lanes[2], lanes[1] ^ lanes[3]) ^ total;
+    return hot_hash64(p, len, h); // Tail below one stride
+}
+
+// Byte range of a file, [offset, offset + length)
+struct BlockRange {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+
+// What changed since the previous version, passed to HotDeltaTask::on_delta()
+struct DeltaReload {
+    int fd = -1;                     // The new version, open for the duration of the callback
+    uint64_t size = 0;               // Size of the new version
+    uint64_t previous_size = 0;      // Size of the previous version, 0 on the first load
+    bool full = false;               // First load: changed covers the whole file
+    std::vector<BlockRange> changed; // Adjacent changed blocks merged, ascending
+
+    // Read a range of the new version, false on a short read
+    bool read(uint64_t offset, uint64_t length, std::string& out) const {
+        out.resize(static_cast<size_t>(length));
+        size_t done = 0;
+        while (done < length) {
+            ssize_t len = ::pread(fd, &out[done], static_cast<size_t>(length) - done,
+                                  static_cast<off_t>(offset + done));
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            if (len <= 0) {
+                out.resize(done);
+                return false;
+            }
+            done += static_cast<size_t>(len);
+        }
+        return true;
+    }
+};
+
+// Task for large files that change a few records at a time. The task keeps
+// a checksum of every block_size block of the last version; on a change it
+// hashes the new version in parallel over blocks and calls on_delta() with
+// only the byte ranges that differ, so the subclass can patch its in-memory
+// structures instead of rebuilding them. Blocks past the end of a shrunk
+// file are not reported, compare size with previous_size.
+//
+// Subclasses call load() at the end of their constructor for the initial
+// full version. The file is hashed, not kept in memory.
+class HotDeltaTask : public HotLoadTask {
+public:
+    explicit HotDeltaTask(const std::string& file, size_t block_size = 64 * 1024, size_t threads = 0)
+        : HotLoadTask(file), _block_size(std::max<size_t>(block_size, 64)),
+          _threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+    // Called with the ranges that differ from the previous version
+    virtual void on_delta(const DeltaReload& delta) = 0;
+
+    void on_reload() override {
+        load();
+    }
+
+    // Hash the current version and report what changed. Returns 0, or -1 if
+    // the file cannot be read; nothing is reported then.
+    int load() {
+        int fd = ::open(watch_file().c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+
+        struct stat st;
+        std::vector<uint64_t> hashes;
+        if (fstat(fd, &st) != 0 || !hash_blocks(fd, static_cast<uint64_t>(st.st_size), hashes)) {
+            close(fd);
+            return -1;
+        }
+
+        DeltaReload delta;
+        delta.fd = fd;
+        delta.size = static_cast<uint64_t>(st.st_size);
+        delta.previous_size = _size;
+        delta.full = !_loaded;
+
+        for (size_t block = 0; block < hashes.size(); ++block) {
+            bool same = !delta.full && block < _hashes.size() && _hashes[block] == hashes[block] &&
+                        block_length(block, _size) == block_length(block, delta.size);
+            if (same) {
+                continue;
+            }
+
+            uint64_t offset = static_cast<uint64_t>(block) * _block_size;
+            uint64_t length = block_length(block, delta.size);
+            if (!delta.changed.empty() && delta.changed.back().offset + delta.changed.back().length == offset) {
+                delta.changed.back().length += length;
+            } else {
+                delta.changed.push_back(BlockRange{offset, length});
+            }
+        }
+
+        _hashes = std::move(hashes);
+        _size = delta.size;
+        _loaded = true;
+
+        if (delta.full || !delta.changed.empty() || delta.size != delta.previous_size) {
+            on_delta(delta);
+        }
+        close(fd);
+        return 0;
+    }
+
+    size_t block_size() const {
+        return _block_size;
+    }
+
+private:
+    uint64_t block_length(size_t block, uint64_t size) const {
+        uint64_t offset = static_cast<uint64_t>(block) * _block_size;
+        return offset >= size ? 0 : std::min<uint64_t>(_block_size, size - offset);
+    }
+
+    // Hash every block, each thread reading a contiguous run of blocks
+    bool hash_blocks(int fd, uint64_t size, std::vector<uint64_t>& hashes) {
+        size_t blocks = static_cast<size_t>((size + _block_size - 1) / _block_size);
+        hashes.assign(blocks, 0);
+
+        std::atomic<bool> failed{false};
+        auto worker = [&](size_t first, size_t last) {
+            constexpr size_t kReadSize = 1 << 20;
+            size_t per_read = std::max<size_t>(1, kReadSize / _block_size);
+            std::vector<char> buffer(per_read * _block_size);
+
+            for (size_t block = first; block < last && !failed.load(std::memory_order_relaxed);) {
+                size_t count = std::min(per_read, last - block);
+                uint64_t offset = static_cast<uint64_t>(block) * _block_size;
+                size_t want = static_cast<size_t>(std::min<uint64_t>(count * _block_size, size - offset));
+
+                size_t done = 0;
+                while (done < want) {
+                    ssize_t len = ::pread(fd, buffer.data() + done, want - done, static_cast<off_t>(offset + done));
+                    if (len < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (len <= 0) {
+                        break; // Truncated meanwhile, the next change notification follows
+                    }
+                    done += static_cast<size_t>(len);
+                }
+                if (done < want) {
+                    failed.store(true, std::memory_order_relaxed);
+                    return;
+                }
+
+                for (size_t i = 0; i < count; ++i) {
+                    size_t len = std::min<size_t>(_block_size, want - i * _block_size);
+                    hashes[block + i] = hot_block_hash(buffer.data() + i * _block_size, len);
+                }
+                block += count;
+            }
+        };
+
+        size_t thread_count = std::min(_threads, std::max<size_t>(1, blocks / 16));
+        size_t per_thread = (blocks + thread_count - 1) / std::max<size_t>(1, thread_count);
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < thread_count; ++t) {
+            size_t first = t * per_thread;
+            if (first < blocks) {
+                threads.emplace_back(worker, first, std::min(blocks, first + per_thread));
+            }
+        }
+        worker(0, std::min(blocks, per_thread)); // The loader thread takes the first run
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return !failed.load();
+    }
+
+private:
+    const size_t _block_size;
+    const size_t _threads;
+
+    // State of the last reported version, only touched from load()
+    std::vector<uint64_t> _hashes;
+    uint64_t _size = 0;
+    bool _loaded = false;
+};
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <unordered_map>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "hot_loader.h"
+
+// Open descriptor of one version of a file. The descriptor is closed when
+// the last holder releases it, so a send in flight keeps the version it
+// started with even after the cache moved on to a newer one.
+struct OpenFile {
+    int fd = -1;
+    off_t size = 0;
+    int64_t mtime_ns = 0;
+    std::string etag; // "<inode>-<size>-<mtime_ns>" in hex, quoted for HTTP
+
+    OpenFile() = default;
+    OpenFile(const OpenFile&) = delete;
+    OpenFile& operator=(const OpenFile&) = delete;
+
+    ~OpenFile() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    static std::shared_ptr<const OpenFile> open(const std::string& file) {
+        auto open_file = std::make_shared<OpenFile>();
+        open_file->fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (open_file->fd < 0) {
+            return nullptr;
+        }
+
+        struct stat st;
+        if (fstat(open_file->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return nullptr;
+        }
+
+        open_file->size = st.st_size;
+        open_file->mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+
+        char etag[64];
+        snprintf(etag, sizeof(etag), "\"%llx-%llx-%llx\"",
+                 static_cast<unsigned long long>(st.st_ino),
+                 static_cast<unsigned long long>(st.st_size),
+                 static_cast<unsigned long long>(open_file->mtime_ns));
+        open_file->etag = etag;
+        return open_file;
+    }
+};
+
+// Counters of an FdCache, updated with relaxed atomics
+struct FdCacheMetrics {
+    std::atomic<uint64_t> hits{0};      // Served with an already open descriptor
+    std::atomic<uint64_t> misses{0};    // Path was not resident and had to be opened
+    std::atomic<uint64_t> reopens{0};   // Resident entries reopened after a change
+    std::atomic<uint64_t> evictions{0}; // Entries dropped to stay within the limit
+};
+
+// Cache of open descriptors for static file serving, e.g. with sendfile().
+// Each resident path is watched through the HotLoader; a change or a
+// replacement of the file makes the next open() reopen it, so serving an
+// unchanged file costs no open/stat/close. At most max_files paths stay
+// open, evicted in CLOCK order. Missing files are not cached.
+class FdCache {
+public:
+    explicit FdCache(size_t max_files = 4096, HotLoader& loader = HotLoader::instance())
+        : _max_files(max_files), _loader(loader) {}
+
+    FdCache(const FdCache&) = delete;
+    FdCache& operator=(const FdCache&) = delete;
+
+    ~FdCache() {
+        clear();
+    }
+
+    // Open descriptor of the current version of a file, null if it cannot be
+    // opened. Keep the result for the duration of the send. Descriptors are
+    // only kept while the HotLoader is running, nothing else invalidates
+    // them: without it every call opens the file again, and entries cached
+    // before stop() are dropped.
+    std::shared_ptr<const OpenFile> open(const std::string& path) {
+        if (!_loader.running()) {
+            clear();
+            _metrics.misses.fetch_add(1, std::memory_order_relaxed);
+            return OpenFile::open(path);
+        }
+
+        std::shared_ptr<Entry> entry;
+        {
+            std::shared_lock<std::shared_mutex> lock(_mutex);
+            auto it = _index.find(path);
+            if (it != _index.end()) {
+                entry = *it->second;
+            }
+        }
+
+        if (entry) {
+            entry->referenced.store(true, std::memory_order_relaxed);
+            if (entry->task->stale.load(std::memory_order_acquire)) {
+                reopen(*entry);
+            }
+
+            std::shared_ptr<const OpenFile> file = std::atomic_load(&entry->file);
+            if (file) {
+                _metrics.hits.fetch_add(1, std::memory_order_relaxed);
+                return file;
+            }
+        }
+
+        _metrics.misses.fetch_add(1, std::memory_order_relaxed);
+        return insert(path);
+    }
+
+    // Drop every entry; descriptors still held by callers stay open
+    void clear() {
+        std::list<std::shared_ptr<Entry>> entries;
+        {
+            std::unique_lock<std::shared_mutex> lock(_mutex);
+            entries.swap(_ring);
+            _index.clear();
+            _hand = _ring.end();
+        }
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        return _ring.size();
+    }
+
+    const FdCacheMetrics& metrics() const {
+        return _metrics;
+    }
+
+private:
+    class EntryTask : public HotLoadTask {
+    public:
+        explicit EntryTask(const std::string& file)
+            : HotLoadTask(file) {}
+
+        void on_reload() override {
+            stale.store(true, std::memory_order_release);
+        }
+
+        void on_remove() override {
+            stale.store(true, std::memory_order_release);
+        }
+
+        std::atomic<bool> stale{false};
+    };
+
+    struct Entry {
+        explicit Entry(HotLoader& loader)
+            : loader(loader) {}
+
+        ~Entry() {
+            loader.unregister_task(task.get());
+        }
+
+        HotLoader& loader;
+        std::string path;
+        std::unique_ptr<EntryTask> task;
+        std::shared_ptr<const OpenFile> file; // Accessed with atomic_load/atomic_store, null while missing
+        std::atomic<bool> referenced{true};
+        std::mutex reopen_mutex;
+    };
+
+    void reopen(Entry& entry) {
+        std::lock_guard<std::mutex> lock(entry.reopen_mutex);
+        if (!entry.task->stale.exchange(false, std::memory_order_acq_rel)) {
+            return; // Reopened by another thread meanwhile
+        }
+
+        // The previous descriptor closes once the last send using it is done
+        std::atomic_store(&entry.file, OpenFile::open(entry.path));
+        _metrics.reopens.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::shared_ptr<const OpenFile> insert(const std::string& path) {
+        auto task = std::make_unique<EntryTask>(path);
+        if (task->watch_file().empty() || !_loader.running() ||
+            _loader.register_task(task.get(), HotLoader::DOESNT_OWN_TASK) != 0) {
+            return OpenFile::open(path); // Missing or not watchable, not cached
+        }
+
+        // Opened after the watch is armed, a change from now on marks it stale
+        auto entry = std::make_shared<Entry>(_loader);
+        entry->path = path;
+        entry->task = std::move(task);
+        entry->file = OpenFile::open(path);
+        std::shared_ptr<const OpenFile> file = entry->file;
+
+        std::list<std::shared_ptr<Entry>> evicted; // Released after the lock is dropped
+        {
+            std::unique_lock<std::shared_mutex> lock(_mutex);
+            auto it = _index.find(path);
+            if (it != _index.end()) {
+                // Replaces a concurrent insert or an entry whose file went missing
+                evicted.push_back(std::move(*it->second));
+                if (_hand == it->second) {
+                    ++_hand;
+                }
+                _ring.erase(it->second);
+                _index.erase(it);
+            }
+
+            auto pos = _ring.insert(_hand, entry);
+            _index.emplace(path, pos);
+            evict(evicted);
+        }
+
+        return file;
+    }
+
+    // Caller must hold _mutex exclusively
+    void evict(std::list<std::shared_ptr<Entry>>& evicted) {
+        while (_ring.size() > _max_files) {
+            if (_hand == _ring.end()) {
+                _hand = _ring.begin();
+            }
+
+            Entry& entry = **_hand;
+            if (entry.referenced.exchange(false, std::memory_order_relaxed)) {
+                ++_hand;
+                continue;
+            }
+
+            _index.erase(entry.path);
+            evicted.push_back(std::move(*_hand));
+            _hand = _ring.erase(_hand);
+            _metrics.evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    const size_t _max_files;
+    HotLoader& _loader;
+
+    mutable std::shared_mutex _mutex; // Guards the ring and the index
+    std::list<std::shared_ptr<Entry>> _ring;
+    std::list<std::shared_ptr<Entry>>::iterator _hand = _ring.end();
+    std::unordered_map<std::string, std::list<std::shared_ptr<Entry>>::iterator> _index;
+
+    FdCacheMetrics _metrics;
+};
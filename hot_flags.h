@@ -0,0 +1,291 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <unordered_map>
+
+#include "hot_loader.h"
+
+// Handle to a boolean flag, one bit of a cache-line-aligned word. Reading is
+// a single relaxed load; copy the handle freely, it stays valid for the
+// lifetime of the task it was bound from.
+class HotFlag {
+public:
+    HotFlag() = default;
+
+    bool get() const {
+        return (_word->load(std::memory_order_relaxed) & _mask) != 0;
+    }
+
+    explicit operator bool() const {
+        return get();
+    }
+
+private:
+    friend class HotFlagsTask;
+
+    HotFlag(const std::atomic<uint64_t>* word, uint64_t mask)
+        : _word(word), _mask(mask) {}
+
+    const std::atomic<uint64_t>* _word = nullptr;
+    uint64_t _mask = 0;
+};
+
+// Handle to a numeric tunable held in its own cache line.
+template <typename T>
+class HotTunable {
+public:
+    HotTunable() = default;
+
+    T get() const {
+        return _value->load(std::memory_order_relaxed);
+    }
+
+    operator T() const {
+        return get();
+    }
+
+private:
+    friend class HotFlagsTask;
+
+    explicit HotTunable(const std::atomic<T>* value)
+        : _value(value) {}
+
+    const std::atomic<T>* _value = nullptr;
+};
+
+// Binds names from a "name = value" file ('#' comments) to pre-registered
+// atomic slots that are updated in place on reload. Flags are packed into
+// 64-bit words, tunables get a cache line each so a write to one does not
+// invalidate readers of another. A name missing from the file goes back to
+// its default; a value that does not parse keeps the previous one. Names in
+// the file that nothing is bound to are ignored.
+class HotFlagsTask : public HotLoadTask {
+public:
+    explicit HotFlagsTask(const std::string& file)
+        : HotLoadTask(file) {
+        std::shared_ptr<const FileSnapshot> content = snapshot();
+        if (content) {
+            parse(content->data, _values);
+        }
+    }
+
+    HotFlag bind_flag(const std::string& name, bool default_value = false) {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        auto it = _flags.find(name);
+        if (it == _flags.end()) {
+            size_t index = _flag_count++;
+            if (index / kFlagsPerLine >= _flag_lines.size()) {
+                _flag_lines.emplace_back();
+            }
+
+            FlagSlot slot;
+            slot.word = &_flag_lines.back().words[(index % kFlagsPerLine) / 64];
+            slot.mask = 1ULL << (index % 64);
+            slot.default_value = default_value;
+            it = _flags.emplace(name, slot).first;
+            store_flag(it->second, default_value); // Kept if the file value does not parse
+            apply_flag(name, it->second);
+        }
+        return HotFlag(it->second.word, it->second.mask);
+    }
+
+    HotTunable<int64_t> bind_int(const std::string& name, int64_t default_value = 0) {
+        return bind_tunable(name, default_value, _ints, _int_slots);
+    }
+
+    HotTunable<double> bind_double(const std::string& name, double default_value = 0.0) {
+        return bind_tunable(name, default_value, _doubles, _double_slots);
+    }
+
+    // Number of reloads applied so far
+    uint64_t generation() const {
+        return _generation.load(std::memory_order_relaxed);
+    }
+
+    void on_reload() override {
+        std::shared_ptr<const FileSnapshot> content = snapshot();
+        if (!content) {
+            return;
+        }
+
+        Values values;
+        parse(content->data, values);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _values = std::move(values);
+        for (const auto& [name, slot] : _flags) {
+            apply_flag(name, slot);
+        }
+        for (const auto& [name, slot] : _ints) {
+            apply_tunable(name, *slot);
+        }
+        for (const auto& [name, slot] : _doubles) {
+            apply_tunable(name, *slot);
+        }
+        _generation.fetch_add(1, std::memory_order_relaxed);
+    }
+
+private:
+    using Values = std::unordered_map<std::string, std::string>;
+
+    constexpr static size_t kCacheLine = 64;
+    constexpr static size_t kFlagsPerLine = kCacheLine * 8;
+
+    struct alignas(kCacheLine) FlagLine {
+        std::atomic<uint64_t> words[kCacheLine / sizeof(uint64_t)] = {};
+    };
+
+    struct FlagSlot {
+        std::atomic<uint64_t>* word = nullptr;
+        uint64_t mask = 0;
+        bool default_value = false;
+    };
+
+    template <typename T>
+    struct alignas(kCacheLine) TunableSlot {
+        std::atomic<T> value{};
+        T default_value{};
+    };
+
+    template <typename T>
+    HotTunable<T> bind_tunable(const std::string& name, T default_value,
+                               std::unordered_map<std::string, TunableSlot<T>*>& index,
+                               std::deque<TunableSlot<T>>& slots) {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        auto it = index.find(name);
+        if (it == index.end()) {
+            slots.emplace_back(); // Deque keeps earlier slots in place
+            slots.back().default_value = default_value;
+            slots.back().value.store(default_value, std::memory_order_relaxed);
+            it = index.emplace(name, &slots.back()).first;
+            apply_tunable(name, *it->second);
+        }
+        return HotTunable<T>(&it->second->value);
+    }
+
+    void apply_flag(const std::string& name, const FlagSlot& slot) {
+        bool value = slot.default_value;
+        auto it = _values.find(name);
+        if (it != _values.end() && !parse_bool(it->second, value)) {
+            return; // Keep the previous value
+        }
+        store_flag(slot, value);
+    }
+
+    static void store_flag(const FlagSlot& slot, bool value) {
+        if (value) {
+            slot.word->fetch_or(slot.mask, std::memory_order_relaxed);
+        } else {
+            slot.word->fetch_and(~slot.mask, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename T>
+    void apply_tunable(const std::string& name, TunableSlot<T>& slot) {
+        T value = slot.default_value;
+        auto it = _values.find(name);
+        if (it != _values.end() && !parse_number(it->second, value)) {
+            return; // Keep the previous value
+        }
+        slot.value.store(value, std::memory_order_relaxed);
+    }
+
+    static bool parse_bool(const std::string& text, bool& value) {
+        if (text == "1" || text == "true" || text == "on" || text == "yes") {
+            value = true;
+            return true;
+        }
+        if (text == "0" || text == "false" || text == "off" || text == "no") {
+            value = false;
+            return true;
+        }
+        return false;
+    }
+
+    // Decimal, or hexadecimal with an explicit 0x prefix. A leading zero is
+    // not octal: "010" is 10.
+    static bool parse_number(const std::string& text, int64_t& value) {
+        size_t sign = (!text.empty() && (text[0] == '+' || text[0] == '-')) ? 1 : 0;
+        bool hex = text.compare(sign, 2, "0x") == 0 || text.compare(sign, 2, "0X") == 0;
+
+        char* end = nullptr;
+        errno = 0;
+        long long parsed = strtoll(text.c_str(), &end, hex ? 16 : 10);
+        if (text.empty() || *end != '\0' || errno == ERANGE) {
+            return false;
+        }
+        value = parsed;
+        return true;
+    }
+
+    static bool parse_number(const std::string& text, double& value) {
+        char* end = nullptr;
+        errno = 0;
+        double parsed = strtod(text.c_str(), &end);
+        if (text.empty() || *end != '\0' || errno == ERANGE) {
+            return false;
+        }
+        value = parsed;
+        return true;
+    }
+
+    static void parse(const std::string& text, Values& values) {
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = text.find('\n', pos);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            std::string line = text.substr(pos, end - pos);
+            pos = end + 1;
+
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) {
+                line.erase(comment);
+            }
+
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) {
+                continue;
+            }
+
+            std::string name = trim(line.substr(0, eq));
+            if (!name.empty()) {
+                values[std::move(name)] = trim(line.substr(eq + 1));
+            }
+        }
+    }
+
+    static std::string trim(const std::string& s) {
+        size_t begin = s.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            return {};
+        }
+        size_t end = s.find_last_not_of(" \t\r");
+        return s.substr(begin, end - begin + 1);
+    }
+
+private:
+    std::mutex _mutex; // Guards binding against reloads, never taken by readers
+    Values _values;    // Last parsed content of the file
+
+    std::deque<FlagLine> _flag_lines;
+    size_t _flag_count = 0;
+    std::unordered_map<std::string, FlagSlot> _flags;
+
+    std::deque<TunableSlot<int64_t>> _int_slots;
+    std::unordered_map<std::string, TunableSlot<int64_t>*> _ints;
+    std::deque<TunableSlot<double>> _double_slots;
+    std::unordered_map<std::string, TunableSlot<double>*> _doubles;
+
+    std::atomic<uint64_t> _generation{0};
+};
@@ -0,0 +1,718 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__PCLMUL__)
+#include <wmmintrin.h>
+#endif
+
+#include "hot_loader.h"
+
+class JsonDocument;
+
+enum JsonType {
+    JSON_INVALID, // Missing member, out of range index or malformed value
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+};
+
+// Position in a JsonDocument. Nothing is converted until asked for: member
+// and element lookups skip over unrelated values in one step using the
+// document's tape, scalars are parsed by the accessor that reads them.
+// Valid as long as the document is held; a failed lookup yields an invalid
+// value on which every further lookup fails too.
+class JsonValue {
+public:
+    JsonValue() = default;
+
+    explicit operator bool() const {
+        return _doc != nullptr;
+    }
+
+    JsonType type() const;
+
+    // Object member by key, invalid if missing or not an object
+    JsonValue operator[](std::string_view key) const;
+
+    // Array element by position, invalid if out of range or not an array
+    JsonValue operator[](size_t index) const;
+
+    // Value at a JSON pointer (RFC 6901) relative to this one, e.g. "/servers/0/port"
+    JsonValue find(std::string_view pointer) const;
+
+    // Number of array elements or object members, 0 for scalars
+    size_t size() const;
+
+    // Text of the value as it appears in the document
+    std::string_view raw() const;
+
+    // Converters returning false, and leaving out alone, on a type mismatch
+    bool get(std::string& out) const;
+    bool get(int64_t& out) const;
+    bool get(double& out) const;
+    bool get(bool& out) const;
+
+    std::string as_string(std::string_view fallback = {}) const {
+        std::string out;
+        return get(out) ? out : std::string(fallback);
+    }
+
+    int64_t as_int(int64_t fallback = 0) const {
+        int64_t out = fallback;
+        get(out);
+        return out;
+    }
+
+    double as_double(double fallback = 0) const {
+        double out = fallback;
+        get(out);
+        return out;
+    }
+
+    bool as_bool(bool fallback = false) const {
+        bool out = fallback;
+        get(out);
+        return out;
+    }
+
+    // Call f(JsonValue) for every array element
+    template <typename F>
+    void for_each_element(F f) const;
+
+    // Call f(std::string_view key, JsonValue value) for every object member.
+    // Keys are passed raw, without unescaping.
+    template <typename F>
+    void for_each_member(F f) const;
+
+private:
+    friend class JsonDocument;
+
+    JsonValue(const JsonDocument* doc, uint32_t token)
+        : _doc(doc), _token(token) {}
+
+    const JsonDocument* _doc = nullptr;
+    uint32_t _token = 0; // Index of the value's first token
+};
+
+// JSON text indexed for on-demand access. Parsing is a single pass that
+// finds every structural character ({}[]:,), string start and scalar start
+// outside of strings, 64 bytes at a time with SIMD compares where available,
+// and records for each container token where its value ends (the tape). No
+// DOM is built: reading three keys of a large file costs the structural
+// pass plus those three lookups.
+//
+// The pass rejects unterminated strings, unbalanced brackets and trailing
+// content; anything else is checked when the value is accessed.
+class JsonDocument {
+public:
+    // Index a text, null with error set if it is malformed
+    static std::shared_ptr<const JsonDocument> parse(std::string text, std::string* error = nullptr) {
+        auto doc = std::shared_ptr<JsonDocument>(new JsonDocument());
+        doc->_owned = std::move(text);
+        doc->_text = doc->_owned;
+        return doc->index(error) ? doc : nullptr;
+    }
+
+    // Index the content of a file snapshot without copying it
+    static std::shared_ptr<const JsonDocument> parse(std::shared_ptr<const FileSnapshot> content,
+                                                     std::string* error = nullptr) {
+        if (!content) {
+            if (error) {
+                *error = "no content";
+            }
+            return nullptr;
+        }
+        auto doc = std::shared_ptr<JsonDocument>(new JsonDocument());
+        doc->_text = content->data;
+        doc->_content = std::move(content);
+        return doc->index(error) ? doc : nullptr;
+    }
+
+    JsonValue root() const {
+        return JsonValue(this, 0);
+    }
+
+    JsonValue find(std::string_view pointer) const {
+        return root().find(pointer);
+    }
+
+    JsonValue operator[](std::string_view key) const {
+        return root()[key];
+    }
+
+    std::string_view text() const {
+        return _text;
+    }
+
+    // Number of indexed tokens, a measure of the structural work done
+    size_t tokens() const {
+        return _positions.size();
+    }
+
+private:
+    friend class JsonValue;
+
+    JsonDocument() = default;
+
+    // Character classes of one 64-byte block, one bit per byte
+    struct BlockMasks {
+        uint64_t quote = 0;
+        uint64_t backslash = 0;
+        uint64_t whitespace = 0;
+        uint64_t op = 0; // {}[]:,
+    };
+
+    static BlockMasks classify(const char* p) {
+        BlockMasks m;
+#if defined(__SSE2__)
+        for (int k = 0; k < 4; ++k) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k));
+            auto eq = [v](char c) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); };
+            auto bits = [](__m128i x) { return static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(x))); };
+
+            int shift = 16 * k;
+            m.quote |= bits(eq('"')) << shift;
+            m.backslash |= bits(eq('\\')) << shift;
+            m.whitespace |= bits(_mm_or_si128(_mm_or_si128(eq(' '), eq('\t')), _mm_or_si128(eq('\n'), eq('\r'))))
+                            << shift;
+            m.op |= bits(_mm_or_si128(_mm_or_si128(_mm_or_si128(eq('{'), eq('}')), _mm_or_si128(eq('['), eq(']'))),
+                                      _mm_or_si128(eq(':'), eq(','))))
+                    << shift;
+        }
+#else
+        for (int i = 0; i < 64; ++i) {
+            uint64_t bit = uint64_t(1) << i;
+            switch (p[i]) {
+            case '"': m.quote |= bit; break;
+            case '\\': m.backslash |= bit; break;
+            case ' ': case '\t': case '\n': case '\r': m.whitespace |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': m.op |= bit; break;
+            default: break;
+            }
+        }
+#endif
+        return m;
+    }
+
+    // Bit i of the result is the xor of bits 0..i, i.e. "inside a string"
+    static uint64_t prefix_xor(uint64_t x) {
+#if defined(__PCLMUL__)
+        __m128i product = _mm_clmulepi64_si128(_mm_set_epi64x(0, static_cast<long long>(x)), _mm_set1_epi8(-1), 0);
+        return static_cast<uint64_t>(_mm_cvtsi128_si64(product));
+#else
+        x ^= x << 1;
+        x ^= x << 2;
+        x ^= x << 4;
+        x ^= x << 8;
+        x ^= x << 16;
+        x ^= x << 32;
+        return x;
+#endif
+    }
+
+    // Characters preceded by an odd run of backslashes. Backslashes are rare
+    // in configs, so they are walked one by one.
+    static uint64_t escaped_bits(uint64_t backslash, uint64_t& carry) {
+        uint64_t escaped = carry;
+        carry = 0;
+        while (backslash) {
+            int i = __builtin_ctzll(backslash);
+            backslash &= backslash - 1;
+            if (escaped & (uint64_t(1) << i)) {
+                continue; // This backslash is itself escaped
+            }
+            if (i == 63) {
+                carry = 1;
+            } else {
+                escaped |= uint64_t(1) << (i + 1);
+            }
+        }
+        return escaped;
+    }
+
+    bool index(std::string* error) {
+        if (_text.size() >= UINT32_MAX) {
+            return fail(error, "document too large");
+        }
+
+        // Stage 1: positions of every token
+        uint64_t escape_carry = 0;
+        uint64_t string_carry = 0; // All ones while inside a string across blocks
+        uint64_t scalar_carry = 0; // Last byte of the previous block was part of a scalar
+        _positions.reserve(_text.size() / 6 + 16);
+
+        for (size_t base = 0; base < _text.size(); base += 64) {
+            const char* p = _text.data() + base;
+            char padded[64];
+            if (_text.size() - base < 64) {
+                memset(padded, ' ', sizeof(padded));
+                memcpy(padded, p, _text.size() - base);
+                p = padded;
+            }
+
+            BlockMasks m = classify(p);
+            uint64_t quote = m.quote & ~escaped_bits(m.backslash, escape_carry);
+            uint64_t in_string = prefix_xor(quote) ^ string_carry;
+            string_carry = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+            uint64_t structural = m.op & ~in_string;
+            uint64_t string_starts = quote & in_string;
+            uint64_t scalar = ~(m.op | m.whitespace | quote | in_string);
+            uint64_t scalar_starts = scalar & ~((scalar << 1) | scalar_carry);
+            scalar_carry = scalar >> 63;
+
+            uint64_t tokens = structural | string_starts | scalar_starts;
+            while (tokens) {
+                _positions.push_back(static_cast<uint32_t>(base + __builtin_ctzll(tokens)));
+                tokens &= tokens - 1;
+            }
+        }
+
+        if (string_carry) {
+            return fail(error, "unterminated string");
+        }
+        if (_positions.empty()) {
+            return fail(error, "empty document");
+        }
+
+        // Stage 2: where every value ends, so lookups can skip it in one step
+        _next.resize(_positions.size());
+        std::vector<uint32_t> open;
+        for (uint32_t i = 0; i < _positions.size(); ++i) {
+            char c = _text[_positions[i]];
+            _next[i] = i + 1;
+            if (c == '{' || c == '[') {
+                open.push_back(i);
+            } else if (c == '}' || c == ']') {
+                if (open.empty() || _text[_positions[open.back()]] != (c == '}' ? '{' : '[')) {
+                    return fail(error, "unbalanced bracket at offset " + std::to_string(_positions[i]));
+                }
+                _next[open.back()] = i + 1;
+                open.pop_back();
+            }
+        }
+
+        if (!open.empty()) {
+            return fail(error, "unclosed bracket at offset " + std::to_string(_positions[open.back()]));
+        }
+        if (_next[0] != _positions.size()) {
+            return fail(error, "trailing content at offset " + std::to_string(_positions[_next[0]]));
+        }
+        return true;
+    }
+
+    static bool fail(std::string* error, const std::string& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+
+    char at(uint32_t token) const {
+        return token < _positions.size() ? _text[_positions[token]] : '\0';
+    }
+
+    // Raw text of a string token including quotes
+    std::string_view string_at(uint32_t token) const {
+        size_t begin = _positions[token];
+        size_t end = begin + 1;
+        while (end < _text.size()) {
+            size_t quote = _text.find('"', end);
+            if (quote == std::string_view::npos) {
+                break;
+            }
+            size_t backslashes = 0;
+            while (quote - backslashes > begin + 1 && _text[quote - backslashes - 1] == '\\') {
+                ++backslashes;
+            }
+            if (backslashes % 2 == 0) {
+                return _text.substr(begin, quote + 1 - begin);
+            }
+            end = quote + 1;
+        }
+        return _text.substr(begin);
+    }
+
+    std::string_view scalar_at(uint32_t token) const {
+        size_t begin = _positions[token];
+        size_t end = _text.find_first_of(" \t\r\n{}[]:,", begin);
+        return _text.substr(begin, (end == std::string_view::npos ? _text.size() : end) - begin);
+    }
+
+    static bool unescape(std::string_view quoted, std::string& out) {
+        if (quoted.size() < 2 || quoted.back() != '"') {
+            return false;
+        }
+        std::string_view s = quoted.substr(1, quoted.size() - 2);
+        out.clear();
+        out.reserve(s.size());
+
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (s[i] != '\\') {
+                out.push_back(s[i]);
+                continue;
+            }
+            if (++i >= s.size()) {
+                return false;
+            }
+            switch (s[i]) {
+            case '"': out.push_back('"'); break;
+            case '\\': out.push_back('\\'); break;
+            case '/': out.push_back('/'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'u': {
+                uint32_t code = 0;
+                if (!hex4(s, i + 1, code)) {
+                    return false;
+                }
+                i += 4;
+                if (code >= 0xD800 && code < 0xDC00 && i + 6 < s.size() && s[i + 1] == '\\' && s[i + 2] == 'u') {
+                    uint32_t low = 0;
+                    if (hex4(s, i + 3, low) && low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+                }
+                append_utf8(code, out);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool hex4(std::string_view s, size_t at, uint32_t& code) {
+        if (at + 4 > s.size()) {
+            return false;
+        }
+        auto result = std::from_chars(s.data() + at, s.data() + at + 4, code, 16);
+        return result.ec == std::errc() && result.ptr == s.data() + at + 4;
+    }
+
+    static void append_utf8(uint32_t code, std::string& out) {
+        if (code < 0x80) {
+            out.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else if (code < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+    }
+
+    // Does the raw key token equal key, unescaping only if it has to
+    bool key_equals(uint32_t token, std::string_view key) const {
+        std::string_view raw = string_at(token);
+        if (raw.size() < 2) {
+            return false;
+        }
+        std::string_view inner = raw.substr(1, raw.size() - 2);
+        if (inner.find('\\') == std::string_view::npos) {
+            return inner == key;
+        }
+        std::string unescaped;
+        return unescape(raw, unescaped) && unescaped == key;
+    }
+
+private:
+    std::shared_ptr<const FileSnapshot> _content; // Owner of _text when parsed from a snapshot
+    std::string _owned;                            // Owner of _text otherwise
+    std::string_view _text;
+    std::vector<uint32_t> _positions;              // Offset of every token
+    std::vector<uint32_t> _next;                   // Token following the value that starts at each token
+};
+
+inline JsonType JsonValue::type() const {
+    if (!_doc) {
+        return JSON_INVALID;
+    }
+    switch (_doc->at(_token)) {
+    case '{': return JSON_OBJECT;
+    case '[': return JSON_ARRAY;
+    case '"': return JSON_STRING;
+    case 't': case 'f': {
+        std::string_view s = _doc->scalar_at(_token);
+        return (s == "true" || s == "false") ? JSON_BOOL : JSON_INVALID;
+    }
+    case 'n':
+        return _doc->scalar_at(_token) == "null" ? JSON_NULL : JSON_INVALID;
+    default: {
+        double number = 0;
+        return get(number) ? JSON_NUMBER : JSON_INVALID;
+    }
+    }
+}
+
+template <typename F>
+void JsonValue::for_each_member(F f) const {
+    if (!_doc || _doc->at(_token) != '{') {
+        return;
+    }
+    uint32_t i = _token + 1;
+    while (_doc->at(i) == '"' && _doc->at(i + 1) == ':') {
+        std::string_view raw = _doc->string_at(i);
+        f(raw.substr(1, raw.size() - 2), JsonValue(_doc, i + 2));
+
+        uint32_t next = _doc->_next[i + 2];
+        if (_doc->at(next) != ',') {
+            return;
+        }
+        i = next + 1;
+    }
+}
+
+template <typename F>
+void JsonValue::for_each_element(F f) const {
+    if (!_doc || _doc->at(_token) != '[' || _doc->at(_token + 1) == ']') {
+        return;
+    }
+    uint32_t i = _token + 1;
+    while (i < _doc->_positions.size()) {
+        f(JsonValue(_doc, i));
+
+        uint32_t next = _doc->_next[i];
+        if (_doc->at(next) != ',') {
+            return;
+        }
+        i = next + 1;
+    }
+}
+
+inline JsonValue JsonValue::operator[](std::string_view key) const {
+    if (!_doc || _doc->at(_token) != '{') {
+        return JsonValue();
+    }
+    uint32_t i = _token + 1;
+    while (_doc->at(i) == '"' && _doc->at(i + 1) == ':') {
+        if (_doc->key_equals(i, key)) {
+            return JsonValue(_doc, i + 2);
+        }
+        uint32_t next = _doc->_next[i + 2]; // Skips a whole nested value in one step
+        if (_doc->at(next) != ',') {
+            break;
+        }
+        i = next + 1;
+    }
+    return JsonValue();
+}
+
+inline JsonValue JsonValue::operator[](size_t index) const {
+    if (!_doc || _doc->at(_token) != '[' || _doc->at(_token + 1) == ']') {
+        return JsonValue();
+    }
+    uint32_t i = _token + 1;
+    for (size_t n = 0; n < index; ++n) {
+        uint32_t next = _doc->_next[i];
+        if (_doc->at(next) != ',') {
+            return JsonValue();
+        }
+        i = next + 1;
+    }
+    return JsonValue(_doc, i);
+}
+
+inline JsonValue JsonValue::find(std::string_view pointer) const {
+    JsonValue value = *this;
+    while (value && !pointer.empty()) {
+        if (pointer[0] != '/') {
+            return JsonValue();
+        }
+        pointer.remove_prefix(1);
+        size_t end = pointer.find('/');
+        std::string_view part = pointer.substr(0, end);
+        pointer = (end == std::string_view::npos) ? std::string_view() : pointer.substr(end);
+
+        std::string key(part);
+        for (size_t pos = 0; (pos = key.find('~', pos)) != std::string::npos; ++pos) {
+            if (pos + 1 < key.size() && (key[pos + 1] == '0' || key[pos + 1] == '1')) {
+                key.replace(pos, 2, key[pos + 1] == '0' ? "~" : "/");
+            }
+        }
+
+        if (value.type() == JSON_ARRAY) {
+            size_t index = 0;
+            auto result = std::from_chars(key.data(), key.data() + key.size(), index);
+            if (key.empty() || result.ec != std::errc() || result.ptr != key.data() + key.size()) {
+                return JsonValue();
+            }
+            value = value[index];
+        } else {
+            value = value[std::string_view(key)];
+        }
+    }
+    return value;
+}
+
+inline size_t JsonValue::size() const {
+    size_t count = 0;
+    if (_doc && _doc->at(_token) == '{') {
+        for_each_member([&count](std::string_view, JsonValue) { ++count; });
+    } else if (_doc && _doc->at(_token) == '[') {
+        for_each_element([&count](JsonValue) { ++count; });
+    }
+    return count;
+}
+
+inline std::string_view JsonValue::raw() const {
+    if (!_doc) {
+        return {};
+    }
+    char c = _doc->at(_token);
+    if (c == '"') {
+        return _doc->string_at(_token);
+    }
+    if (c == '{' || c == '[') {
+        uint32_t last = _doc->_next[_token] - 1; // The closing bracket
+        return _doc->_text.substr(_doc->_positions[_token], _doc->_positions[last] + 1 - _doc->_positions[_token]);
+    }
+    return _doc->scalar_at(_token);
+}
+
+inline bool JsonValue::get(std::string& out) const {
+    if (!_doc || _doc->at(_token) != '"') {
+        return false;
+    }
+    std::string value;
+    if (!JsonDocument::unescape(_doc->string_at(_token), value)) {
+        return false;
+    }
+    out = std::move(value);
+    return true;
+}
+
+inline bool JsonValue::get(int64_t& out) const {
+    if (!_doc) {
+        return false;
+    }
+    std::string_view s = _doc->scalar_at(_token);
+    int64_t value = 0;
+    auto result = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (result.ec != std::errc() || result.ptr != s.data() + s.size()) {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+inline bool JsonValue::get(double& out) const {
+    if (!_doc) {
+        return false;
+    }
+    char c = _doc->at(_token);
+    if (c != '-' && (c < '0' || c > '9')) {
+        return false; // from_chars would also take "inf" and "nan"
+    }
+    std::string_view s = _doc->scalar_at(_token);
+    double value = 0;
+    auto result = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (result.ec != std::errc() || result.ptr != s.data() + s.size()) {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+inline bool JsonValue::get(bool& out) const {
+    if (!_doc) {
+        return false;
+    }
+    std::string_view s = _doc->scalar_at(_token);
+    if (s == "true" || s == "false") {
+        out = (s == "true");
+        return true;
+    }
+    return false;
+}
+
+// Task keeping a JSON file indexed as a JsonDocument. The document shares
+// the loader's snapshot of the file, and tasks on the same inode share one
+// document per version, indexed once. A malformed version is not
+// published; the previous document stays and last_error() tells why.
+class HotJsonTask : public HotLoadTask {
+public:
+    explicit HotJsonTask(const std::string& file)
+        : HotLoadTask(file) {
+        if (!load()) {
+            _document.publish(JsonDocument::parse(std::string("null"))); // Readers never see null
+        }
+    }
+
+    // Current document, keep it while reading values from it
+    std::shared_ptr<const JsonDocument> document() const {
+        return _document.load();
+    }
+
+    // Number of documents published so far
+    uint64_t generation() const {
+        return _document.version();
+    }
+
+    std::string last_error() const {
+        std::lock_guard<std::mutex> lock(_error_mutex);
+        return _last_error;
+    }
+
+    void on_reload() override {
+        load();
+    }
+
+private:
+    // One parse per file version, shared by every HotJsonTask on the file
+    struct Parsed {
+        std::shared_ptr<const JsonDocument> document;
+        std::string error;
+    };
+
+    struct Parser {
+        std::shared_ptr<const Parsed> operator()(const std::shared_ptr<const FileSnapshot>& content) const {
+            auto result = std::make_shared<Parsed>();
+            result->document = JsonDocument::parse(content, &result->error);
+            return result;
+        }
+    };
+
+    bool load() {
+        std::shared_ptr<const Parsed> result = parsed<Parser>();
+
+        std::lock_guard<std::mutex> lock(_error_mutex);
+        if (!result || !result->document) {
+            _last_error = result ? result->error : "no content";
+            return false;
+        }
+        _last_error.clear();
+        _document.publish(result->document);
+        return true;
+    }
+
+private:
+    HotValue<JsonDocument> _document;
+    mutable std::mutex _error_mutex;
+    std::string _last_error;
+};
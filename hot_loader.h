@@ -6,21 +6,608 @@
 #include <thread>
 #include <climits>
 #include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <list>
+#include <map>
+#include <future>
+#include <typeindex>
 #include <filesystem>
 #include <functional>
 #include <algorithm>
 #include <vector>
-
+#include <memory>
+#include <memory_resource>
+#include <iterator>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <type_traits>
+#include <sstream>
+
+#include <time.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Identity and version of a file as seen by stat(), used to detect changes
+// that happened while no inotify watch was able to report them.
+struct FileFingerprint {
+    dev_t dev = 0;
+    ino_t ino = 0;
+    off_t size = -1;
+    int64_t mtime_ns = 0;
+    int64_t ctime_ns = 0;
+
+    bool valid() const {
+        return size >= 0;
+    }
+
+    bool operator==(const FileFingerprint& other) const {
+        return dev == other.dev && ino == other.ino && size == other.size &&
+               mtime_ns == other.mtime_ns && ctime_ns == other.ctime_ns;
+    }
+
+    bool operator!=(const FileFingerprint& other) const {
+        return !(*this == other);
+    }
+
+    static FileFingerprint of(const std::string& file) {
+        return of(file.c_str());
+    }
+
+    static FileFingerprint of(const char* file) {
+        FileFingerprint fp;
+        struct stat st;
+        if (::stat(file, &st) != 0) {
+            return fp; // Invalid fingerprint, file is missing or unreadable
+        }
+
+        fp.dev = st.st_dev;
+        fp.ino = st.st_ino;
+        fp.size = st.st_size;
+        fp.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        fp.ctime_ns = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000LL + st.st_ctim.tv_nsec;
+        return fp;
+    }
+};
+
+// Fast non-cryptographic 64-bit hash (wyhash style multiply-mix), used for
+// content checksums and hash based lookup structures.
+inline uint64_t hot_mix64(uint64_t a, uint64_t b) {
+    unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+inline uint64_t hot_hash64(const void* data, size_t len, uint64_t seed = 0) {
+    constexpr uint64_t k0 = 0xa0761d6478bd642fULL;
+    constexpr uint64_t k1 = 0xe7037ed1a0b428dbULL;
+    constexpr uint64_t k2 = 0x8ebc6af09c88c6e3ULL;
+
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = hot_mix64(seed ^ k0, k1) ^ len;
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    while (len > 16) {
+        memcpy(&a, p, 8);
+        memcpy(&b, p + 8, 8);
+        h = hot_mix64(a ^ k1, b ^ h);
+        p += 16;
+        len -= 16;
+    }
+
+    unsigned char tail[16] = {0};
+    memcpy(tail, p, len);
+    memcpy(&a, tail, 8);
+    memcpy(&b, tail + 8, 8);
+    return hot_mix64(h ^ k2, hot_mix64(a ^ k1, b ^ h));
+}
+
+// Content of a watched file at one generation.
+struct FileSnapshot {
+    std::string path;            // Path the content was read from
+    FileFingerprint fingerprint; // Fingerprint of the file when it was read
+    uint64_t generation = 0;     // Generation of the inode the content belongs to
+    std::string data;
+
+    static std::shared_ptr<const FileSnapshot> read(const std::string& file, uint64_t generation) {
+        int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return nullptr;
+        }
+
+        auto snapshot = read_fd(fd, file, generation);
+        close(fd);
+        return snapshot;
+    }
+
+    // Read an open file from offset 0, which also re-arms priority
+    // notifications of sysfs/cgroupfs attributes
+    static std::shared_ptr<const FileSnapshot> read_fd(int fd, const std::string& file, uint64_t generation) {
+        auto snapshot = std::make_shared<FileSnapshot>();
+        snapshot->path = file;
+        snapshot->generation = generation;
+        if (!read_all(fd, snapshot->data)) {
+            return nullptr;
+        }
+
+        snapshot->fingerprint = FileFingerprint::of(file);
+        return snapshot;
+    }
+
+    // Read an open file from offset 0 into a string the caller owns, for
+    // content that is handed over rather than shared
+    static bool read_all(int fd, std::string& data) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            data.reserve(static_cast<size_t>(st.st_size));
+        }
+
+        char buf[64 * 1024];
+        off_t offset = 0;
+        while (true) {
+            ssize_t len = ::pread(fd, buf, sizeof(buf), offset);
+            if (len < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            if (len == 0) {
+                break;
+            }
+            data.append(buf, static_cast<size_t>(len));
+            offset += len;
+        }
+        return true;
+    }
+};
+
+// Monotonic arena holding the parsed state of one file generation. Objects
+// built with make() keep the arena alive; once the last of them is released
+// the whole generation is freed in one shot instead of object by object.
+// Like any monotonic_buffer_resource it must not be used concurrently, build
+// snapshots from the reload callback and only read them from other threads.
+class HotArena {
+public:
+    explicit HotArena(uint64_t generation,
+                      std::pmr::memory_resource* upstream = std::pmr::get_default_resource(),
+                      size_t initial_size = 64 * 1024)
+        : _generation(generation), _resource(initial_size, upstream) {}
+
+    HotArena(const HotArena&) = delete;
+    HotArena& operator=(const HotArena&) = delete;
+
+    std::pmr::memory_resource* resource() {
+        return &_resource;
+    }
+
+    uint64_t generation() const {
+        return _generation;
+    }
+
+    // Construct an immutable T inside the arena. Allocator-aware members
+    // (std::pmr containers and strings) allocate from the arena as well.
+    template <typename T, typename... Args>
+    static std::shared_ptr<const T> make(const std::shared_ptr<HotArena>& arena, Args&&... args) {
+        std::pmr::polymorphic_allocator<T> alloc(arena->resource());
+        T* object = alloc.allocate(1);
+        try {
+            alloc.construct(object, std::forward<Args>(args)...);
+        } catch (...) {
+            alloc.deallocate(object, 1);
+            throw;
+        }
+
+        // Memory is reclaimed with the arena, the deleter only runs the destructor
+        return std::shared_ptr<const T>(object, [arena](const T* value) { value->~T(); });
+    }
+
+private:
+    uint64_t _generation;
+    std::pmr::monotonic_buffer_resource _resource;
+};
+
+// Watch and content shared by every registered path that refers to the same
+// (dev, inode), e.g. hardlinks or the same file seen through a bind mount.
+// The watch fields are owned by HotLoader and guarded by its mutex; the
+// snapshot and parse caches have their own locks so tasks can read them
+// from any thread.
+struct HotInode {
+    explicit HotInode(std::pmr::memory_resource* resource)
+        : paths(resource), _resource(resource), _parsed(resource) {}
+
+    dev_t dev = 0;
+    ino_t ino = 0;
+    int wd = -1;                                // Inotify watch descriptor
+    bool oneshot = false;                       // Armed with IN_ONESHOT, re-armed after each dispatch
+    FileFingerprint fingerprint;                // Fingerprint at the last dispatch
+    std::pmr::vector<std::pmr::string> paths;   // Registered paths referring to this inode
+    std::atomic<uint64_t> generation{0};        // Bumped on every dispatched change
+
+    // Read the content once per generation, whichever path asks first
+    std::shared_ptr<const FileSnapshot> load_snapshot(const std::string& file) {
+        std::lock_guard<std::mutex> lock(_snapshot_mutex);
+
+        uint64_t current = generation.load(std::memory_order_acquire);
+        if (_snapshot && _snapshot->generation == current) {
+            return _snapshot;
+        }
+
+        auto snapshot = FileSnapshot::read(file, current);
+        if (snapshot) {
+            _snapshot = snapshot;
+        }
+        return snapshot;
+    }
+
+    // Install content read by the loader itself, e.g. from a priority attribute
+    void store_snapshot(std::shared_ptr<const FileSnapshot> snapshot) {
+        std::lock_guard<std::mutex> lock(_snapshot_mutex);
+        _snapshot = std::move(snapshot);
+    }
+
+    // Arena of the current generation, shared by every task on this inode
+    std::shared_ptr<HotArena> load_arena() {
+        std::lock_guard<std::mutex> lock(_snapshot_mutex);
+
+        uint64_t current = generation.load(std::memory_order_acquire);
+        if (!_arena || _arena->generation() != current) {
+            _arena = std::make_shared<HotArena>(current, _resource);
+        }
+        return _arena;
+    }
+
+    // Result of a parser for the generation of a snapshot of this inode.
+    // The first caller parses, outside of any lock; callers asking for the
+    // same generation meanwhile wait for it and share the result. Only the
+    // newest generation is kept per parser.
+    template <typename Parse>
+    std::shared_ptr<const void> load_parsed(std::type_index parser, const std::string& key,
+                                            const std::shared_ptr<const FileSnapshot>& snapshot, Parse&& parse) {
+        std::promise<std::shared_ptr<const void>> promise;
+        std::shared_future<std::shared_ptr<const void>> result;
+        bool owner = false;
+        {
+            std::lock_guard<std::mutex> lock(_parsed_mutex);
+
+            ParsedResult& cached = _parsed[ParserId(parser, std::pmr::string(key, _resource))];
+            if (cached.value.valid() && cached.generation > snapshot->generation) {
+                return parse(snapshot); // Caller holds an outdated snapshot, nothing to share
+            }
+            if (!cached.value.valid() || cached.generation != snapshot->generation) {
+                cached.generation = snapshot->generation;
+                cached.value = promise.get_future().share();
+                owner = true;
+            }
+            result = cached.value;
+        }
+
+        if (owner) {
+            try {
+                promise.set_value(parse(snapshot));
+            } catch (...) {
+                promise.set_exception(std::current_exception()); // Waiting callers see the same failure
+            }
+        }
+        return result.get();
+    }
+
+private:
+    using ParserId = std::pair<std::type_index, std::pmr::string>;
+
+    struct ParsedResult {
+        uint64_t generation = 0;
+        std::shared_future<std::shared_ptr<const void>> value;
+    };
+
+    std::pmr::memory_resource* _resource;          // Upstream of the generation arenas
+    std::mutex _snapshot_mutex;
+    std::shared_ptr<const FileSnapshot> _snapshot; // Content at _snapshot->generation
+    std::shared_ptr<HotArena> _arena;              // Arena of _arena->generation()
+    std::mutex _parsed_mutex;
+    std::pmr::map<ParserId, ParsedResult> _parsed; // Newest result of each parser
+};
+
+// Counters describing the health of the HotLoader event loop.
+struct HotLoaderMetrics {
+    std::atomic<uint64_t> reloads{0};           // Number of on_reload() dispatches
+    std::atomic<uint64_t> recoveries{0};        // Number of times inotify/epoll were recreated
+    std::atomic<uint64_t> recovery_failures{0}; // Number of failed attempts to recreate them
+    std::atomic<uint64_t> resync_reloads{0};    // Reloads dispatched by fingerprint resync
+    std::atomic<uint64_t> queue_overflows{0};   // Number of IN_Q_OVERFLOW events received
+    std::atomic<uint64_t> mount_changes{0};     // Number of mount table changes handled
+    std::atomic<uint64_t> deferred_reloads{0};  // Callbacks a tenant quota postponed to a later pass
+    std::atomic<int> last_error{0};             // errno of the last fatal event loop error
+};
+
+// Limits of one tenant namespace, see HotLoader::set_tenant_limits(). Zero
+// means unlimited. Callbacks over the rate or CPU limit are not dropped but
+// postponed, and coalesced per task while they wait.
+struct HotTenantLimits {
+    size_t max_watches = 0;                      // Registered tasks plus the dependencies they track
+    double reloads_per_second = 0;               // Sustained callback rate
+    double reload_burst = 0;                     // Callbacks allowed back to back, one second's worth if 0
+    std::chrono::milliseconds cpu_per_second{0}; // CPU time of callbacks per second of wall time
+};
+
+struct HotTenantStats {
+    size_t tasks = 0;
+    size_t watches = 0;
+    size_t pending = 0;                   // Callbacks waiting for quota
+    uint64_t callbacks = 0;               // Callbacks made
+    uint64_t deferred = 0;                // Callbacks that ran in a later pass than their change
+    uint64_t rejected_watches = 0;        // Registrations and dependencies refused by max_watches
+    std::chrono::nanoseconds cpu_time{0}; // CPU time spent in callbacks
+};
+
+// Loader-wide publish sequence. Every HotValue publish made on a thread with
+// an open wave is tagged with that wave's number, and read transactions only
+// see waves that have committed, so values published in one wave appear to
+// them all at once. HotLoader opens a wave around each batch of reload
+// callbacks; application code can group its own publishes with a HotWave on
+// the stack. Waves nest per thread; overlapping waves of different threads
+// commit together once the last of them ends. Publishes outside any wave
+// are visible at once.
+class HotWave {
+public:
+    HotWave() {
+        if (_depth++ > 0) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(state().mutex);
+        _open = ++state().latest;
+        ++state().active;
+    }
+
+    ~HotWave() {
+        if (--_depth > 0) {
+            return;
+        }
+
+        _open = 0;
+        std::lock_guard<std::mutex> lock(state().mutex);
+        if (--state().active == 0) {
+            state().committed.store(state().latest, std::memory_order_release);
+        }
+    }
+
+    HotWave(const HotWave&) = delete;
+    HotWave& operator=(const HotWave&) = delete;
+
+    // Newest wave whose publishes are all visible
+    static uint64_t committed() {
+        return state().committed.load(std::memory_order_acquire);
+    }
+
+    // Wave a publish on the calling thread belongs to
+    static uint64_t publish_epoch() {
+        return _open ? _open : committed();
+    }
+
+private:
+    struct State {
+        std::mutex mutex;                 // Guards latest and active, never held by readers
+        uint64_t latest = 0;              // Last wave number handed out
+        size_t active = 0;                // Waves begun and not yet ended
+        std::atomic<uint64_t> committed{0};
+    };
+
+    static State& state() {
+        static State state;
+        return state;
+    }
+
+    inline static thread_local uint64_t _open = 0;  // Wave of the calling thread, 0 if none
+    inline static thread_local size_t _depth = 0;
+};
+
+// Holder of an immutable snapshot that a reload callback replaces atomically
+// while any number of reader threads keep using the snapshot they loaded.
+// Besides the current snapshot it keeps the previous one, tagged with their
+// waves, for read transactions (see HotReadTransaction).
+template <typename T>
+class HotValue {
+public:
+    using Snapshot = std::shared_ptr<const T>;
+
+    HotValue() = default;
+
+    explicit HotValue(Snapshot initial)
+        : _snapshot(initial), _head(std::make_shared<const Version>(Version{std::move(initial), 0, nullptr})) {}
+
+    HotValue(const HotValue&) = delete;
+    HotValue& operator=(const HotValue&) = delete;
+
+    // Current snapshot, may be null if nothing was published yet
+    Snapshot load() const {
+        return std::atomic_load_explicit(&_snapshot, std::memory_order_acquire);
+    }
+
+    // Newest snapshot published in a wave up to epoch. Clears consistent if
+    // every kept snapshot is newer, i.e. the value was published in two
+    // waves since epoch; the oldest kept one is returned then.
+    Snapshot load_at(uint64_t epoch, bool& consistent) const {
+        std::shared_ptr<const Version> head = std::atomic_load_explicit(&_head, std::memory_order_acquire);
+        const Version* version = head.get();
+        for (; version; version = version->previous.get()) {
+            if (version->epoch <= epoch) {
+                return version->snapshot;
+            }
+            if (!version->previous) {
+                consistent = false;
+                return version->snapshot;
+            }
+        }
+        return nullptr;
+    }
+
+    void publish(Snapshot snapshot) {
+        uint64_t epoch = HotWave::publish_epoch();
+        std::shared_ptr<const Version> head = std::atomic_load_explicit(&_head, std::memory_order_acquire);
+
+        // Keep one older version; a second publish in the same wave replaces the first
+        std::shared_ptr<const Version> previous;
+        if (head && head->epoch == epoch) {
+            previous = head->previous;
+        } else if (head) {
+            previous = std::make_shared<const Version>(Version{head->snapshot, head->epoch, nullptr});
+        } else {
+            previous = std::make_shared<const Version>(); // Transactions from before the first publish see null
+        }
+
+        auto version = std::make_shared<const Version>(Version{snapshot, epoch, std::move(previous)});
+        std::atomic_store_explicit(&_head, std::move(version), std::memory_order_release);
+        std::atomic_store_explicit(&_snapshot, std::move(snapshot), std::memory_order_release);
+        _version.fetch_add(1, std::memory_order_release);
+    }
+
+    // Number of snapshots published so far
+    uint64_t version() const {
+        return _version.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Version {
+        Snapshot snapshot;
+        uint64_t epoch = 0;                     // Wave the snapshot was published in
+        std::shared_ptr<const Version> previous;
+    };
+
+    Snapshot _snapshot;                 // Same as _head->snapshot, kept apart so load() stays one atomic load
+    std::shared_ptr<const Version> _head;
+    std::atomic<uint64_t> _version{0};
+};
+
+// Consistent cut across several HotValues. The transaction pins the last
+// committed wave when it is created; every load() then returns the snapshot
+// that was current at that wave, so a request sees either all or none of the
+// values published in a later wave. Reads take no lock.
+//
+// Only the previous snapshot of each value is kept: if a value was published
+// in two waves since the transaction began, consistent() turns false and the
+// caller should start a new transaction.
+//
+//     HotReadTransaction tx;
+//     auto routes = tx.load(routing);
+//     auto limits = tx.load(rate_limits);
+class HotReadTransaction {
+public:
+    HotReadTransaction()
+        : _epoch(HotWave::committed()) {}
+
+    template <typename T>
+    std::shared_ptr<const T> load(const HotValue<T>& value) {
+        return value.load_at(_epoch, _consistent);
+    }
+
+    uint64_t epoch() const {
+        return _epoch;
+    }
+
+    bool consistent() const {
+        return _consistent;
+    }
+
+private:
+    uint64_t _epoch;
+    bool _consistent = true;
+};
+
+// Holder of a small trivially copyable value published through a seqlock.
+// Neither side allocates; readers copy the value out and retry if a store
+// overlapped, stores never wait for readers. The value is kept as atomic
+// words so concurrent copies are well-defined.
+template <typename T>
+class HotPod {
+    static_assert(std::is_trivially_copyable<T>::value, "HotPod requires a trivially copyable type");
+
+public:
+    HotPod()
+        : HotPod(T()) {}
+
+    explicit HotPod(const T& initial) {
+        store_words(initial);
+    }
+
+    HotPod(const HotPod&) = delete;
+    HotPod& operator=(const HotPod&) = delete;
+
+    T load() const {
+        uint64_t buffer[kWords];
+        while (true) {
+            uint64_t begin = _sequence.load(std::memory_order_acquire);
+            if (begin & 1) {
+                continue; // Store in progress
+            }
+
+            for (size_t i = 0; i < kWords; ++i) {
+                buffer[i] = _words[i].load(std::memory_order_relaxed);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_sequence.load(std::memory_order_relaxed) == begin) {
+                break;
+            }
+        }
+
+        T value;
+        memcpy(&value, buffer, sizeof(T));
+        return value;
+    }
+
+    // Safe to call from several threads, concurrent stores are serialized
+    void store(const T& value) {
+        uint64_t sequence = _sequence.load(std::memory_order_relaxed);
+        while (true) {
+            if (!(sequence & 1) &&
+                _sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_relaxed)) {
+                break;
+            }
+            sequence = _sequence.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        store_words(value);
+        _sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Number of values stored so far, excluding the initial one
+    uint64_t version() const {
+        return _sequence.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    constexpr static size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    void store_words(const T& value) {
+        uint64_t buffer[kWords] = {};
+        memcpy(buffer, &value, sizeof(T));
+        for (size_t i = 0; i < kWords; ++i) {
+            _words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::atomic<uint64_t> _sequence{0}; // Odd while a store is in progress
+    std::atomic<uint64_t> _words[kWords];
+};
 
 class HotLoadTask {
     friend class HotLoader; // Allow HotLoader to access private members
 public:
 
     HotLoadTask(const std::string& file)
-        : _file(normalize_path(file)), _watch_descriptor(-1) {}
+        : _file(normalize_path(file)) {}
 
     virtual ~HotLoadTask() = default;
 
@@ -28,14 +615,94 @@ public:
         return _file;
     }
 
+    // Files read during the last load besides watch_file(), e.g. included configs
+    const std::vector<std::string>& dependencies() const {
+        return _dependencies;
+    }
+
+    // Tenant namespace the task was registered in, empty for the default one
+    const std::string& tenant() const {
+        return _tenant;
+    }
+
+    // Content of watch_file() at its current generation. Tasks watching the
+    // same inode, through any path, share one read and one snapshot.
+    std::shared_ptr<const FileSnapshot> snapshot() const {
+        std::shared_ptr<HotInode> inode = std::atomic_load(&_inode);
+        if (!inode) {
+            return FileSnapshot::read(_file, 0); // Not registered or file missing
+        }
+        return inode->load_snapshot(_file);
+    }
+
+    // Parsed form of watch_file() at its current generation. Tasks on the
+    // same inode asking with the same parser type (and key, for parsers of
+    // one type configured differently) share one parse per generation and
+    // get the same immutable object, null results included. Parser is a
+    // callable taking const std::shared_ptr<const FileSnapshot>& and
+    // returning std::shared_ptr<const T>. Null if the file cannot be read.
+    template <typename Parser>
+    auto parsed(const Parser& parser = Parser(), const std::string& key = std::string()) const
+        -> decltype(parser(std::shared_ptr<const FileSnapshot>())) {
+        using Result = decltype(parser(std::shared_ptr<const FileSnapshot>()));
+
+        std::shared_ptr<HotInode> inode = std::atomic_load(&_inode);
+        std::shared_ptr<const FileSnapshot> content = inode ? inode->load_snapshot(_file) : FileSnapshot::read(_file, 0);
+        if (!content) {
+            return nullptr;
+        }
+        if (!inode) {
+            return parser(content); // Not registered, nothing to share with
+        }
+
+        auto parse = [&parser](const std::shared_ptr<const FileSnapshot>& snapshot) -> std::shared_ptr<const void> {
+            return parser(snapshot);
+        };
+        return std::static_pointer_cast<typename Result::element_type>(
+            inode->load_parsed(typeid(Parser), key, content, parse));
+    }
+
+    // Arena for state built from the current generation of watch_file(). The
+    // previous generation is released once nothing built in it is referenced.
+    std::shared_ptr<HotArena> generation_arena() const {
+        std::shared_ptr<HotInode> inode = std::atomic_load(&_inode);
+        if (!inode) {
+            return std::make_shared<HotArena>(0); // Not registered or file missing
+        }
+        return inode->load_arena();
+    }
+
     virtual void on_reload() {}
 
+    // Called when one of dependencies() changed, reloads the whole task by default
+    virtual void on_dependency_reload(const std::string& file) {
+        (void)file;
+        on_reload();
+    }
+
+    // Called when watch_file() was deleted or renamed away. The task stays
+    // registered and gets on_reload() once the file is back.
+    virtual void on_remove() {}
+
     static std::string normalize_path(const std::string& input_path) {
         try {
             if (!std::filesystem::exists(input_path) || !std::filesystem::is_regular_file(input_path)) {
                 return {}; // Return empty string if path does not exist
             }
 
+            return absolute_path(input_path);
+        } catch (...) {
+            return {}; // Return empty string on error
+        }
+    }
+
+    // Same as normalize_path() but the file does not need to exist
+    static std::string absolute_path(const std::string& input_path) {
+        try {
+            if (input_path.empty()) {
+                return {};
+            }
+
             // Convert to absolute path (if input is relative)
             std::filesystem::path absolute_path = std::filesystem::absolute(input_path);
             
@@ -52,18 +719,28 @@ public:
         }
     }
 
-private:
-    int watch_descriptor() const {
-        return _watch_descriptor;
-    }
+protected:
+    // Record a file read while loading (from the constructor or a reload
+    // callback). After each reload the recorded set replaces dependencies()
+    // and HotLoader watches it on behalf of this task.
+    void track_dependency(const std::string& file) {
+        std::string path = absolute_path(file);
+        if (path.empty() || path == _file) {
+            return;
+        }
 
-    void set_watch_descriptor(int wd) {
-        _watch_descriptor = wd;
+        if (std::find(_tracked_dependencies.begin(), _tracked_dependencies.end(), path) ==
+            _tracked_dependencies.end()) {
+            _tracked_dependencies.push_back(std::move(path));
+        }
     }
 
 private:
     std::string _file;
-    int _watch_descriptor; // Inotify watch descriptor
+    std::vector<std::string> _dependencies;         // Dependencies currently watched by HotLoader
+    std::vector<std::string> _tracked_dependencies; // Dependencies recorded since the last reload
+    std::shared_ptr<HotInode> _inode;               // Shared watch state of watch_file(), set by HotLoader
+    std::string _tenant;                            // Set by HotLoader on registration
 };
 
 class HotLoader final {
@@ -71,14 +748,33 @@ public:
     constexpr static int kMaxEventCount = 1024; // Maximum number of events to handle at once
     constexpr static int kEventBufferSize = 1024 * (sizeof(struct inotify_event) + NAME_MAX + 1); // Buffer size for inotify events
     constexpr static int kEpollTimeout = 1000; // Timeout for epoll_wait, -1 means wait indefinitely
+    constexpr static size_t kBulkUnwatchThreshold = 64; // From this many watches a new inotify instance beats inotify_rm_watch() per watch
+    constexpr static size_t kTasksPerDeleteThread = 4096; // Smallest share of owned tasks worth a thread in TEARDOWN_PARALLEL
+    constexpr static const char* kMountInfoFile = "/proc/self/mountinfo"; // Signals mount table changes with EPOLLPRI
 
-    constexpr static int kWatchEventMask = IN_CLOSE_WRITE | IN_IGNORED;
+    // IN_ATTRIB reports link count changes: a file replaced or deleted while
+    // someone keeps it open gets no IN_IGNORED until the last close
+    constexpr static int kWatchEventMask = IN_CLOSE_WRITE | IN_ATTRIB | IN_IGNORED;
 
     enum OwnerShip {
         OWN_TASK, // HotLoader owns the task and will delete it
         DOESNT_OWN_TASK // HotLoader does not own the task, caller is responsible for deletion
     };
 
+    // How unregister_all_tasks() disposes of the tasks it owns. The registry
+    // itself is always released outside of the loader lock.
+    enum TeardownMode {
+        TEARDOWN_INLINE,   // Delete owned tasks on the calling thread before returning
+        TEARDOWN_PARALLEL, // Delete them on several threads before returning
+        TEARDOWN_DEFERRED, // Delete them on a background thread, return at once
+    };
+
+    enum WatchMode {
+        WATCH_INOTIFY,  // Regular file, reloaded on IN_CLOSE_WRITE and replacement
+        WATCH_PRIORITY, // sysfs/cgroupfs/procfs attribute that signals changes with EPOLLPRI
+        WATCH_ONESHOT   // Like WATCH_INOTIFY, but the kernel reports at most one event per reload
+    };
+
     static HotLoader& instance() {
         static HotLoader instance;
         return instance;
@@ -89,399 +785,1897 @@ public:
             return 0; // Already initialized
         }
 
-        _inotify_fd = inotify_init1(IN_NONBLOCK);
-        if (_inotify_fd < 0) {
-            return -1; // Failed to initialize inotify
+        int ret = create_file_descriptors();
+        if (ret != 0) {
+            return ret;
         }
 
-        _epoll_fd = epoll_create1(0);
-        if (_epoll_fd < 0) {
-            close_file_descriptors();
-            return -2; // Failed to create epoll instance
+        _initialized.store(true); // Mark HotLoader as initialized
+
+        return 0;
+    }
+
+    // Take over the watches of a predecessor process instead of init(). The
+    // inotify fd is either inherited across exec (pass -1 to use the number
+    // recorded in the state) or received with receive_handoff(). Tasks
+    // registered before run() reuse the inherited watches, so events queued
+    // during the upgrade are delivered; run() then drops watches nobody
+    // registered again and reloads files whose fingerprint differs from the
+    // one the predecessor dispatched last.
+    int adopt(const std::string& state, int inotify_fd = -1) {
+        if (_initialized.load()) {
+            return -1; // Already initialized
         }
 
-        struct epoll_event event;
-        event.events = EPOLLIN | EPOLLET; // Edge-triggered mode
-        event.data.fd = _inotify_fd; // Associate the inotify fd with the event
-        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _inotify_fd, &event) < 0) {
-            close_file_descriptors();
-            perror("epoll_ctl failed");
-            return -3; // Failed to add inotify fd to epoll
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        int recorded_fd = -1;
+        if (!parse_state(state, recorded_fd)) {
+            _adopted.clear();
+            return -3; // Malformed state
+        }
+
+        if (inotify_fd < 0) {
+            inotify_fd = recorded_fd;
+        }
+        if (inotify_fd < 0 || fcntl(inotify_fd, F_SETFD, FD_CLOEXEC) != 0) {
+            _adopted.clear();
+            return -4; // No usable inotify fd
+        }
+
+        int ret = create_file_descriptors(inotify_fd);
+        if (ret != 0) {
+            _adopted.clear();
+            return ret;
+        }
+
+        _initialized.store(true);
+
+        return 0;
+    }
+
+    // Stop processing events and describe the registry (paths, fingerprints,
+    // generations) for a successor process. The inotify fd is left open
+    // across exec, or can be sent with send_handoff(). Watches are kept in
+    // the shared inotify instance even when this process unregisters its
+    // tasks or exits afterwards.
+    int handoff(std::string& state) {
+        if (!_initialized.load()) {
+            return -2; // HotLoader not initialized
+        }
+
+        _running.store(false);
+        wake_worker();
+        if (_worker_thread.joinable() && _worker_thread.get_id() != std::this_thread::get_id()) {
+            _worker_thread.join();
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        if (_inotify_fd < 0 || fcntl(_inotify_fd, F_SETFD, 0) != 0) {
+            return -4; // Inotify instance unavailable
+        }
+
+        std::ostringstream out;
+        out << "hotloader-state 1\n";
+        out << "fd " << _inotify_fd << "\n";
+        for (const auto& [id, inode] : _inodes) {
+            if (inode->wd < 0) {
+                continue;
+            }
+
+            const FileFingerprint& fp = inode->fingerprint;
+            out << "inode " << inode->dev << ' ' << inode->ino << ' ' << fp.size << ' ' << fp.mtime_ns << ' '
+                << fp.ctime_ns << ' ' << inode->generation.load() << ' ' << inode->paths.size() << "\n";
+            for (const auto& path : inode->paths) {
+                out << path.size() << ' ' << path << "\n"; // Length prefixed, paths may contain anything
+            }
+        }
+        state = out.str();
+
+        _handed_off = true;
+
+        return 0;
+    }
+
+    int inotify_fd() const {
+        return _inotify_fd;
+    }
+
+    // Send a handoff state and the inotify fd over a connected unix socket
+    static int send_handoff(int socket, const std::string& state, int fd) {
+        uint64_t length = state.size();
+        struct iovec iov = {&length, sizeof(length)};
+
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+        if (sendmsg(socket, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(length))) {
+            return -1; // Failed to send the fd
+        }
+
+        for (size_t sent = 0; sent < state.size();) {
+            ssize_t len = send(socket, state.data() + sent, state.size() - sent, MSG_NOSIGNAL);
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            if (len <= 0) {
+                return -2; // Failed to send the state
+            }
+            sent += static_cast<size_t>(len);
+        }
+
+        return 0;
+    }
+
+    // Receive what send_handoff() sent, the fd can be passed to adopt()
+    static int receive_handoff(int socket, std::string& state, int& fd) {
+        uint64_t length = 0;
+        struct iovec iov = {&length, sizeof(length)};
+
+        char control[CMSG_SPACE(sizeof(int))] = {};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(socket, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL) != static_cast<ssize_t>(sizeof(length))) {
+            return -1; // Failed to receive the fd
+        }
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            return -1; // No fd attached
+        }
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+        state.resize(length);
+        for (size_t received = 0; received < state.size();) {
+            ssize_t len = recv(socket, &state[received], state.size() - received, 0);
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            if (len <= 0) {
+                close(fd);
+                fd = -1;
+                return -2; // Failed to receive the state
+            }
+            received += static_cast<size_t>(len);
+        }
+
+        return 0;
+    }
+
+    const HotLoaderMetrics& metrics() const {
+        return _metrics;
+    }
+
+    // Route the loader's own allocations (registry, per-file task lists,
+    // shared inode state, per-event bookkeeping) and the upstream of the
+    // generation arenas through a custom resource. Only allowed while no
+    // task is registered and no adopted watch is pending; the resource must
+    // outlive the HotLoader. It must be thread-safe (e.g. a
+    // synchronized_pool_resource): the registry allocates under the loader
+    // lock, but arenas draw from it in reload callbacks and application
+    // threads as well.
+    int set_memory_resource(std::pmr::memory_resource* resource) {
+        if (!resource) {
+            return -1; // Invalid resource
+        }
+
+        join_teardown(); // A deferred teardown still frees into the current resource
+
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        if (!_files.empty() || !_attributes.empty()) {
+            return -3; // Tasks already registered
+        }
+        if (!_adopted.empty()) {
+            return -3; // Watches handed off by adopt() not taken over by run() yet
+        }
+        for (const auto& [name, tenant] : _tenants) {
+            if (!tenant.tasks.empty() || !tenant.pending.empty()) {
+                return -3; // Tasks or their callbacks still held by a tenant
+            }
+        }
+
+        // Tenant namespaces survive the switch, only their limits are kept
+        std::vector<std::pair<std::string, HotTenantLimits>> tenants;
+        for (const auto& [name, tenant] : _tenants) {
+            tenants.emplace_back(std::string(name.data(), name.size()), tenant.limits);
+        }
+
+        // Give back what the empty containers still hold before switching
+        FileMap(&_resource).swap(_files);
+        decltype(_inodes)(&_resource).swap(_inodes);
+        decltype(_watch_descriptors)(&_resource).swap(_watch_descriptors);
+        decltype(_adopted)(&_resource).swap(_adopted);
+        decltype(_attributes)(&_resource).swap(_attributes);
+        TenantMap(&_resource).swap(_tenants);
+        decltype(_backlog)(&_resource).swap(_backlog);
+
+        _resource.target = resource;
+
+        for (const auto& [name, limits] : tenants) {
+            set_limits(_tenants.try_emplace(to_path(name), &_resource).first->second, limits);
+        }
+
+        return 0; // Success
+    }
+
+    // Create a tenant namespace or change its limits (thread safe). Tasks
+    // are placed in a tenant with the register_task() overload taking its
+    // name; the default namespace "" exists implicitly and is unlimited
+    // unless limited here as well.
+    int set_tenant_limits(const std::string& tenant, const HotTenantLimits& limits) {
+        if (limits.reloads_per_second < 0 || limits.reload_burst < 0 || limits.cpu_per_second.count() < 0) {
+            return -1; // Invalid limits
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        set_limits(_tenants.try_emplace(to_path(tenant), &_resource).first->second, limits);
+
+        return 0; // Success
+    }
+
+    int tenant_stats(const std::string& tenant, HotTenantStats& stats) {
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        auto it = _tenants.find(to_path(tenant));
+        if (it == _tenants.end()) {
+            return -4; // Tenant not found
+        }
+
+        stats = it->second.stats;
+        stats.tasks = it->second.tasks.size();
+        stats.watches = it->second.watches;
+        stats.pending = it->second.pending.size();
+
+        return 0; // Success
+    }
+
+    int register_task(HotLoadTask* task, OwnerShip ownership, WatchMode mode = WATCH_INOTIFY) {
+        return register_task(task, ownership, std::string(), mode);
+    }
+
+    // Register a task in a tenant namespace created with set_tenant_limits().
+    // Its watches count against the tenant's max_watches, and its callbacks
+    // are scheduled fairly against those of other tenants.
+    int register_task(HotLoadTask* task, OwnerShip ownership, const std::string& tenant,
+                      WatchMode mode = WATCH_INOTIFY) {
+        if (!task) {
+            return -1; // Invalid task pointer
+        }
+
+        if (!_initialized.load()) {
+            return -2; // HotLoader not initialized
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        if (task->watch_file().empty()) {
+            return -4; // File did not exist when the task was created
+        }
+
+        auto current = _tenants.find(to_path(task->_tenant));
+        if (current != _tenants.end() && current->second.tasks.count(task) != 0) {
+            return -3; // Task already registered
+        }
+
+        auto tenant_it = _tenants.find(to_path(tenant));
+        if (tenant_it == _tenants.end()) {
+            if (!tenant.empty()) {
+                return -5; // Unknown tenant
+            }
+            tenant_it = _tenants.try_emplace(to_path(tenant), &_resource).first; // Default namespace
+        }
+
+        Tenant& owner = tenant_it->second;
+        if (owner.limits.max_watches != 0 && owner.watches >= owner.limits.max_watches) {
+            owner.stats.rejected_watches++;
+            return -6; // Tenant watch quota exhausted
+        }
+
+        std::string previous_tenant = std::move(task->_tenant);
+        task->_tenant = tenant;
+        owner.tasks.insert(task);
+        owner.watches++;
+
+        int ret = (mode == WATCH_PRIORITY) ? register_priority_task(task, ownership)
+                                           : register_inotify_task(task, ownership, mode);
+        if (ret != 0) {
+            owner.tasks.erase(task);
+            owner.watches--;
+            task->_tenant = std::move(previous_tenant);
+        }
+
+        return ret;
+    }
+
+    int unregister_task(HotLoadTask* task) {
+        if (!task) {
+            return -1; // Invalid task pointer
+        }
+
+        if (!_initialized.load()) {
+            return -2; // HotLoader not initialized
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        OwnerShip ownership = DOESNT_OWN_TASK;
+        if (!detach_task(task, ownership)) {
+            return -4; // Task not found
+        }
+
+        // Delete the task if HotLoader owns it
+        if (ownership == OWN_TASK) {
+            delete task;
+        }
+
+        return 0; // Success
+    }
+
+    int unregister_task(const std::string& file) {
+        if (!_initialized.load()) {
+            return -2; // HotLoader not initialized
+        }
+
+        std::string normalize_file = HotLoadTask::normalize_path(file);
+        if (normalize_file.empty()) {
+            return -3; // Invalid file path
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        std::pmr::vector<TaskInfo> task_list(&_resource);
+
+        auto it = _files.find(to_path(normalize_file));
+        if (it != _files.end()) {
+            task_list.swap(it->second.tasks);
+
+            // Remove the inotify watch unless other tasks depend on this file
+            release_if_unused(it);
+        }
+
+        for (auto attr = _attributes.begin(); attr != _attributes.end(); ++attr) {
+            if (attr->second.path == to_path(normalize_file)) {
+                task_list.insert(task_list.end(), attr->second.tasks.begin(), attr->second.tasks.end());
+                close_attribute(attr);
+                break;
+            }
+        }
+
+        if (task_list.empty()) {
+            return -4; // Task not found
+        }
+
+        // Remove all tasks for this file
+        for (const auto& task_info : task_list) {
+            HotLoadTask* task = task_info.task;
+            std::atomic_store(&task->_inode, std::shared_ptr<HotInode>());
+            release_dependencies(task);
+            forget_task(task);
+
+            if (task_info.ownership == OWN_TASK) {
+                delete task; // Delete the task if HotLoader owns it
+            }
+        }
+
+        return 0; // Success
+    }
+
+    int unregister_all_tasks(TeardownMode mode = TEARDOWN_INLINE) {
+        if (!_initialized.load()) {
+            return -1; // HotLoader not initialized
+        }
+
+        std::vector<HotLoadTask*> owned;
+        RetiredRegistry retired(&_resource);
+        {
+            std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+            drop_all_watches();
+
+            auto release = [&owned](const TaskInfo& task_info) {
+                HotLoadTask* task = task_info.task;
+                std::atomic_store(&task->_inode, std::shared_ptr<HotInode>());
+                task->_dependencies.clear();
+                task->_tracked_dependencies.clear();
+
+                if (task_info.ownership == OWN_TASK) {
+                    owned.push_back(task); // Deleted once the lock is released
+                }
+            };
+
+            for (auto& [file, watch] : _files) {
+                for (const auto& task_info : watch.tasks) {
+                    release(task_info);
+                }
+            }
+
+            for (auto& [fd, attribute] : _attributes) {
+                close(fd);
+                for (const auto& task_info : attribute.tasks) {
+                    release(task_info);
+                }
+            }
+
+            // Tenants keep their limits, their tasks and pending callbacks are gone
+            for (auto& [name, tenant] : _tenants) {
+                tenant.tasks.clear();
+                tenant.pending.clear();
+                tenant.queued.clear();
+                tenant.watches = 0;
+                tenant.in_backlog = false; // Listed again by the next enqueue()
+            }
+            _backlog.clear();
+
+            // Node by node deallocation happens later, without the lock
+            retired.files.swap(_files);
+            retired.inodes.swap(_inodes);
+            retired.watch_descriptors.swap(_watch_descriptors);
+            retired.attributes.swap(_attributes);
+        }
+
+        dispose(std::move(owned), std::move(retired), mode);
+
+        return 0; // Success
+    }
+
+    // Unregister every task of a tenant and remove the namespace. The
+    // tenant's own task set is walked, other tenants are not looked at;
+    // owned tasks are deleted as mode says, outside of the loader lock.
+    int unregister_tenant(const std::string& tenant, TeardownMode mode = TEARDOWN_INLINE) {
+        if (!_initialized.load()) {
+            return -2; // HotLoader not initialized
+        }
+
+        std::vector<HotLoadTask*> owned;
+        {
+            std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+            auto it = _tenants.find(to_path(tenant));
+            if (it == _tenants.end()) {
+                return -4; // Tenant not found
+            }
+
+            std::vector<HotLoadTask*> tasks(it->second.tasks.begin(), it->second.tasks.end());
+            for (HotLoadTask* task : tasks) {
+                OwnerShip ownership = DOESNT_OWN_TASK;
+                if (detach_task(task, ownership) && ownership == OWN_TASK) {
+                    owned.push_back(task);
+                }
+            }
+
+            _backlog.erase(std::remove(_backlog.begin(), _backlog.end(), &it->second), _backlog.end());
+            _tenants.erase(it);
+        }
+
+        dispose(std::move(owned), RetiredRegistry(&_resource), mode);
+
+        return 0; // Success
+    }
+
+    int run() {
+        if (_running.load()) {
+            return -1; // HotLoader already running
+        }
+
+        if (!_initialized.load()) {
+            return -2; // HotLoader not initialized
+        }
+
+        _running.store(true); // Set the running flag to true
+
+        _worker_thread = std::thread(std::bind(&HotLoader::work_loop, this));
+
+        return 0; // Success
+    }
+
+    // Whether the worker thread dispatches changes, i.e. between run() and stop()
+    bool running() const {
+        return _running.load();
+    }
+
+    void stop() {
+        _running.store(false); // Set the running flag to false
+        wake_worker();
+
+        if (_worker_thread.joinable() && _worker_thread.get_id() != std::this_thread::get_id()) {
+            _worker_thread.join(); // Wait for the worker thread to finish
+        }
+
+        unregister_all_tasks(); // Unregister all tasks
+    }
+
+private:
+    struct TaskInfo {
+        HotLoadTask* task;
+        OwnerShip ownership;
+        WatchMode mode;
+
+        TaskInfo(HotLoadTask* t, OwnerShip o, WatchMode m = WATCH_INOTIFY) : task(t), ownership(o), mode(m) {}
+        TaskInfo() : task(nullptr), ownership(DOESNT_OWN_TASK), mode(WATCH_INOTIFY) {}
+    };
+
+    // Everything interested in one file path
+    struct FileWatch {
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        explicit FileWatch(const allocator_type& alloc)
+            : tasks(alloc), dependents(alloc) {}
+
+        FileWatch(const FileWatch& other, const allocator_type& alloc)
+            : tasks(other.tasks, alloc), dependents(other.dependents, alloc), inode(other.inode) {}
+
+        FileWatch(FileWatch&& other, const allocator_type& alloc)
+            : tasks(std::move(other.tasks), alloc), dependents(std::move(other.dependents), alloc),
+              inode(std::move(other.inode)) {}
+
+        std::pmr::vector<TaskInfo> tasks;          // Tasks watching this file directly
+        std::pmr::vector<HotLoadTask*> dependents; // Tasks that read this file during their last load
+        std::shared_ptr<HotInode> inode;           // Watch of the inode the path refers to, null while missing
+    };
+
+    using Path = std::pmr::string;
+
+    // An attribute file registered with WATCH_PRIORITY, kept open and polled
+    // for EPOLLPRI; keyed by its fd
+    struct AttributeWatch {
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        explicit AttributeWatch(const allocator_type& alloc)
+            : path(alloc), tasks(alloc) {}
+
+        AttributeWatch(AttributeWatch&& other, const allocator_type& alloc)
+            : path(std::move(other.path), alloc), tasks(std::move(other.tasks), alloc),
+              inode(std::move(other.inode)) {}
+
+        Path path;
+        std::pmr::vector<TaskInfo> tasks;
+        std::shared_ptr<HotInode> inode; // Generation and snapshot shared by the tasks, wd is -1
+    };
+
+    using AttributeMap = std::pmr::unordered_map<int, AttributeWatch>;
+
+    using PathList = std::pmr::vector<Path>;
+    using FileMap = std::pmr::unordered_map<Path, FileWatch>;
+
+    // Memory resource the registry is built on, forwards to the resource
+    // chosen with set_memory_resource()
+    class ForwardingResource : public std::pmr::memory_resource {
+    public:
+        std::pmr::memory_resource* target = std::pmr::get_default_resource();
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override {
+            return target->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+            target->deallocate(p, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    // Watch state received from a predecessor process, see adopt()
+    struct AdoptedInode {
+        dev_t dev = 0;
+        ino_t ino = 0;
+        FileFingerprint fingerprint;
+        uint64_t generation = 0;
+    };
+
+    struct FileId {
+        dev_t dev;
+        ino_t ino;
+
+        bool operator==(const FileId& other) const {
+            return dev == other.dev && ino == other.ino;
+        }
+    };
+
+    struct FileIdHash {
+        size_t operator()(const FileId& id) const {
+            return std::hash<uint64_t>()((static_cast<uint64_t>(id.dev) * 0x9e3779b97f4a7c15ULL) ^ id.ino);
+        }
+    };
+
+    using InodeMap = std::pmr::unordered_map<FileId, std::shared_ptr<HotInode>, FileIdHash>;
+    using WatchDescriptorMap = std::pmr::unordered_map<int, std::shared_ptr<HotInode>>;
+
+    using Clock = std::chrono::steady_clock;
+
+    enum CallbackKind {
+        CALLBACK_RELOAD,     // on_reload()
+        CALLBACK_DEPENDENCY, // on_dependency_reload()
+        CALLBACK_REMOVE      // on_remove()
+    };
+
+    struct PendingCallback {
+        HotLoadTask* task;
+        CallbackKind kind;
+        PathList dependencies; // Changed files of a CALLBACK_DEPENDENCY, each delivered once
+        uint64_t round;  // Dispatch pass the change arrived in
+    };
+
+    // A tenant namespace: its tasks, how many watches they hold, the quota
+    // buckets and the callbacks waiting for quota, oldest first and at most
+    // one per task
+    struct Tenant {
+        using PendingList = std::pmr::list<PendingCallback>;
+
+        explicit Tenant(std::pmr::memory_resource* resource)
+            : tasks(resource), pending(resource), queued(resource) {}
+
+        HotTenantLimits limits;
+        HotTenantStats stats; // Counters only, sizes are filled in by tenant_stats()
+        std::pmr::unordered_set<HotLoadTask*> tasks;
+        size_t watches = 0;
+        PendingList pending;
+        std::pmr::unordered_map<HotLoadTask*, PendingList::iterator> queued;
+        bool in_backlog = false; // Listed in _backlog
+        double tokens = 0;       // Callbacks the rate limit allows right now
+        double cpu_credit = 0;   // CPU nanoseconds callbacks may still use, negative when overdrawn
+        Clock::time_point refilled;
+    };
+
+    using TenantMap = std::pmr::unordered_map<Path, Tenant>;
+
+    HotLoader() = default;
+    HotLoader(const HotLoader&) = delete;
+    HotLoader& operator=(const HotLoader&) = delete;
+    HotLoader(HotLoader&&) = delete;
+    HotLoader& operator=(HotLoader&&) = delete;
+
+    ~HotLoader() {
+        stop();
+        join_teardown();
+        close_file_descriptors();
+    }
+
+    int create_file_descriptors(int inotify_fd = -1) {
+        _inotify_fd = (inotify_fd >= 0) ? inotify_fd : inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_inotify_fd < 0) {
+            return -1; // Failed to initialize inotify
+        }
+
+        _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (_epoll_fd < 0) {
+            close_file_descriptors();
+            return -2; // Failed to create epoll instance
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLET; // Edge-triggered mode
+        event.data.fd = _inotify_fd; // Associate the inotify fd with the event
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _inotify_fd, &event) < 0) {
+            close_file_descriptors();
+            perror("epoll_ctl failed");
+            return -3; // Failed to add inotify fd to epoll
+        }
+
+        // Lets stop() end epoll_wait() at once instead of after kEpollTimeout
+        _wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_wake_fd >= 0) {
+            event.events = EPOLLIN;
+            event.data.fd = _wake_fd;
+            if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &event) < 0) {
+                close(_wake_fd);
+                _wake_fd = -1;
+            }
+        }
+
+        // The mount table signals changes with EPOLLPRI. Optional: without it
+        // remounts are only noticed through IN_IGNORED and polling.
+        _mountinfo_fd = ::open(kMountInfoFile, O_RDONLY | O_CLOEXEC);
+        if (_mountinfo_fd >= 0) {
+            event.events = EPOLLPRI | EPOLLERR | EPOLLET;
+            event.data.fd = _mountinfo_fd;
+            if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _mountinfo_fd, &event) < 0) {
+                close(_mountinfo_fd);
+                _mountinfo_fd = -1;
+            }
+        }
+
+        return 0;
+    }
+
+    void close_file_descriptors() {
+        if (_inotify_fd >= 0) {
+            close(_inotify_fd);
+            _inotify_fd = -1;
+        }
+        if (_epoll_fd >= 0) {
+            close(_epoll_fd);
+            _epoll_fd = -1;
+        }
+        if (_mountinfo_fd >= 0) {
+            close(_mountinfo_fd);
+            _mountinfo_fd = -1;
+        }
+        if (_wake_fd >= 0) {
+            close(_wake_fd);
+            _wake_fd = -1;
+        }
+    }
+
+    void work_loop() {
+        static struct epoll_event events[kMaxEventCount];
+        static char event_buf[kEventBufferSize];
+
+        finish_adoption();
+
+        while (_running.load()) {
+            if (_epoll_fd < 0 && !recover_file_descriptors(_metrics.last_error.load())) {
+                // Previous recovery failed, back off before trying again
+                std::this_thread::sleep_for(std::chrono::milliseconds(kEpollTimeout));
+                continue;
+            }
+
+            restart_stopped_tasks();
+            int timeout = dispatch_deferred(); // Sooner while callbacks wait for tenant quota
+
+            int n_ready = epoll_wait(_epoll_fd, events, kMaxEventCount, timeout);
+            if (n_ready < 0) {
+                if (errno == EINTR) {
+                    continue; // Interrupted, retry
+                }
+
+                perror("epoll_wait failed");
+                recover_file_descriptors(errno);
+                continue; // Event loop recreated, start over
+            }
+
+            if (n_ready == 0) {
+                continue; // No events ready, continue the loop
+            }
+
+            std::pmr::unordered_map<int, uint32_t> event_masks(&_resource);
+            std::pmr::vector<int> attribute_fds(&_resource);
+            bool mounts_changed = false;
+            bool read_failed = false;
+
+            for (int i = 0; i < n_ready && !read_failed; ++i) {
+                if (events[i].data.fd == _wake_fd) {
+                    uint64_t count = 0;
+                    ssize_t drained = read(_wake_fd, &count, sizeof(count)); // The loop condition does the rest
+                    (void)drained;
+                } else if (events[i].data.fd == _mountinfo_fd) {
+                    mounts_changed = true;
+                } else if (events[i].data.fd != _inotify_fd) {
+                    attribute_fds.push_back(events[i].data.fd);
+                } else {
+                    while (true) {
+                        ssize_t len = read(_inotify_fd, event_buf, kEventBufferSize);
+                        if (len < 0) {
+                            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                                break; // No more events or interrupted, break the loop
+                            } else if (errno == EINTR) {
+                                continue; // Interrupted, retry reading
+                            }
+
+                            perror("read inotify events");
+                            read_failed = true;
+                            break;
+                        }
+
+                        for (char* ptr = event_buf; ptr < event_buf + len;) {
+                            struct inotify_event* event = reinterpret_cast<struct inotify_event*>(ptr);
+                            ptr += sizeof(struct inotify_event) + event->len;
+
+                            event_masks[event->wd] |= event->mask; // Aggregate event masks
+                        }
+                    }
+                }
+            }
+
+            if (read_failed) {
+                // Events already read are dropped, the resync after recovery covers them
+                recover_file_descriptors(errno);
+                continue;
+            }
+
+            // Process the aggregated events
+            std::lock_guard<std::mutex> lock(_mutex); // Lock to ensure thread safety
+            HotWave wave; // Everything reloaded from this batch becomes visible at once
+
+            dispatch_attributes(attribute_fds);
+
+            std::pmr::vector<std::shared_ptr<HotInode>> rearm(&_resource);
+
+            auto overflow = event_masks.find(-1);
+            if (overflow != event_masks.end() && (overflow->second & IN_Q_OVERFLOW)) {
+                // The kernel dropped events, compare fingerprints to find what changed
+                _metrics.queue_overflows++;
+                event_masks.erase(overflow);
+                resync_fingerprints();
+
+                // A dropped event may have consumed a oneshot watch, arm them all again
+                for (const auto& [id, inode] : _inodes) {
+                    if (inode->oneshot && inode->wd >= 0) {
+                        _watch_descriptors.erase(inode->wd);
+                        inode->wd = -1;
+                        rearm.push_back(inode);
+                    }
+                }
+            }
+
+            PathList changed_files(&_resource);
+            PathList removed_files(&_resource);
+            if (mounts_changed) {
+                // Before the events: watches moved away here no longer match their wd
+                _metrics.mount_changes++;
+                revalidate_watches(changed_files, removed_files);
+            }
+
+            for (const auto& [wd, mask] : event_masks) {
+                auto it = _watch_descriptors.find(wd);
+                if (it == _watch_descriptors.end()) {
+                    continue;
+                }
+
+                // Every path referring to the inode sees the change
+                std::shared_ptr<HotInode> inode = it->second;
+                if (inode->oneshot) {
+                    // The kernel removed the watch with this event, armed again after the reload
+                    _watch_descriptors.erase(it);
+                    inode->wd = -1;
+                    rearm.push_back(inode);
+                }
+
+                // A oneshot watch always ends with IN_IGNORED, only the file system tells if it went away
+                bool gone = inode->oneshot ? is_unlinked(*inode)
+                                           : (mask & IN_IGNORED) || ((mask & IN_ATTRIB) && is_unlinked(*inode));
+                if (gone) {
+                    // Inode was deleted or replaced, watch the new inode of each path if there is one
+                    rewatch_inode(inode, changed_files, removed_files);
+                } else if (mask & IN_CLOSE_WRITE) {
+                    changed_files.insert(changed_files.end(), inode->paths.begin(), inode->paths.end());
+                }
+            }
+
+            dispatch_changes(changed_files, removed_files);
+            rearm_oneshot(rearm);
+        }
+    }
+
+    // Parse the output of handoff() into _adopted. Caller must hold _mutex.
+    bool parse_state(const std::string& state, int& fd) {
+        std::istringstream in(state);
+        std::string word;
+        int version = 0;
+        if (!(in >> word >> version) || word != "hotloader-state" || version != 1) {
+            return false;
+        }
+        if (!(in >> word >> fd) || word != "fd") {
+            return false;
+        }
+
+        while (in >> word) {
+            AdoptedInode adopted;
+            size_t path_count = 0;
+            if (word != "inode" ||
+                !(in >> adopted.dev >> adopted.ino >> adopted.fingerprint.size >> adopted.fingerprint.mtime_ns >>
+                  adopted.fingerprint.ctime_ns >> adopted.generation >> path_count)) {
+                return false;
+            }
+            adopted.fingerprint.dev = adopted.dev;
+            adopted.fingerprint.ino = adopted.ino;
+
+            for (size_t i = 0; i < path_count; ++i) {
+                size_t length = 0;
+                if (!(in >> length) || in.get() != ' ') {
+                    return false;
+                }
+
+                Path path(length, '\0', &_resource);
+                if (!in.read(&path[0], static_cast<std::streamsize>(length))) {
+                    return false;
+                }
+                _adopted.emplace(std::move(path), adopted);
+            }
+        }
+        return true;
+    }
+
+    // Drop inherited watches no task registered again and reload what changed
+    // while no process was dispatching. Called from the worker thread only.
+    void finish_adoption() {
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        if (_adopted.empty()) {
+            return;
+        }
+
+        // Inherited watches of inodes no path was registered for again
+        for (const auto& [path, adopted] : _adopted) {
+            FileId id{adopted.dev, adopted.ino};
+            FileFingerprint fp = FileFingerprint::of(path.c_str());
+            if (_inodes.count(id) > 0 || fp.dev != id.dev || fp.ino != id.ino) {
+                continue; // Still in use, or gone and its watch with it
+            }
+
+            // Adding a watch for a watched inode returns its existing wd
+            int wd = inotify_add_watch(_inotify_fd, path.c_str(), kWatchEventMask);
+            if (wd >= 0 && _watch_descriptors.count(wd) == 0) {
+                inotify_rm_watch(_inotify_fd, wd);
+            }
+        }
+
+        _adopted.clear();
+        resync_fingerprints();
+    }
+
+    // Recreate the inotify and epoll instances after a fatal error, re-arm
+    // every registered watch and dispatch the changes missed in between.
+    // Called from the worker thread only.
+    bool recover_file_descriptors(int error) {
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        _metrics.last_error.store(error);
+        close_file_descriptors();
+
+        // Every watch died with the old inotify instance
+        _watch_descriptors.clear();
+        for (auto& [id, inode] : _inodes) {
+            inode->wd = -1;
+        }
+
+        if (create_file_descriptors() != 0) {
+            _metrics.recovery_failures++;
+            return false; // Retried by the work loop after a back off
+        }
+
+        _metrics.recoveries++;
+
+        for (auto& [fd, attribute] : _attributes) {
+            add_attribute_to_epoll(fd);
+        }
+
+        std::pmr::vector<std::shared_ptr<HotInode>> lost(&_resource);
+        for (auto& [id, inode] : _inodes) {
+            int wd = inotify_add_watch(_inotify_fd, inode->paths[0].c_str(),
+                                       kWatchEventMask | (inode->oneshot ? IN_ONESHOT : 0));
+            if (wd >= 0 && FileFingerprint::of(inode->paths[0].c_str()).ino == inode->ino) {
+                inode->wd = wd;
+                _watch_descriptors[wd] = inode;
+            } else {
+                lost.push_back(inode);
+            }
+        }
+
+        // Inodes that went away meanwhile are picked up by restart_stopped_tasks()
+        PathList changed_files(&_resource);
+        PathList removed_files(&_resource);
+        for (const auto& inode : lost) {
+            rewatch_inode(inode, changed_files, removed_files);
+        }
+        _metrics.resync_reloads += dispatch_changes(changed_files, removed_files);
+
+        resync_fingerprints();
+
+        return true;
+    }
+
+    // Reload every watched file whose fingerprint differs from the one taken
+    // at its last dispatch. Caller must hold _mutex.
+    void resync_fingerprints() {
+        PathList changed_files(&_resource);
+        for (const auto& [id, inode] : _inodes) {
+            if (inode->wd >= 0 && FileFingerprint::of(inode->paths[0].c_str()) != inode->fingerprint) {
+                changed_files.insert(changed_files.end(), inode->paths.begin(), inode->paths.end());
+            }
+        }
+
+        _metrics.resync_reloads += dispatch_changes(changed_files);
+    }
+
+    // Registry containers taken out of the loader by unregister_all_tasks()
+    struct RetiredRegistry {
+        explicit RetiredRegistry(std::pmr::memory_resource* resource)
+            : files(resource), inodes(resource), watch_descriptors(resource), attributes(resource) {}
+
+        FileMap files;
+        InodeMap inodes;
+        WatchDescriptorMap watch_descriptors;
+        AttributeMap attributes;
+    };
+
+    void wake_worker() {
+        if (_wake_fd >= 0) {
+            uint64_t one = 1;
+            ssize_t written = write(_wake_fd, &one, sizeof(one));
+            (void)written; // A full counter wakes the loop just as well
+        }
+    }
+
+    // Remove every inotify watch. Each inotify_rm_watch() is a system call
+    // that also waits for the kernel to retire the mark, so for large
+    // registries the whole instance is replaced instead: closing it drops all
+    // its watches at once. dup3() keeps the fd number the worker thread uses.
+    // Caller must hold _mutex.
+    void drop_all_watches() {
+        if (_handed_off || _inotify_fd < 0) {
+            return; // The watches belong to the successor after a handoff
+        }
+
+        if (_watch_descriptors.size() >= kBulkUnwatchThreshold) {
+            int fresh = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (fresh >= 0 && dup3(fresh, _inotify_fd, O_CLOEXEC) >= 0) {
+                close(fresh);
+
+                // The old instance left the epoll set when it was closed
+                struct epoll_event event;
+                event.events = EPOLLIN | EPOLLET;
+                event.data.fd = _inotify_fd;
+                if (_epoll_fd >= 0 && epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _inotify_fd, &event) < 0 &&
+                    errno == EEXIST) {
+                    epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, _inotify_fd, &event);
+                }
+                return;
+            }
+            if (fresh >= 0) {
+                close(fresh);
+            }
+        }
+
+        for (const auto& [wd, inode] : _watch_descriptors) {
+            inotify_rm_watch(_inotify_fd, wd);
+        }
+    }
+
+    // Delete owned tasks and free the retired registry as the mode says
+    void dispose(std::vector<HotLoadTask*> owned, RetiredRegistry retired, TeardownMode mode) {
+        if (mode == TEARDOWN_DEFERRED) {
+            join_teardown(); // One background teardown at a time
+            _teardown_thread = std::thread([owned = std::move(owned), retired = std::move(retired)]() mutable {
+                for (HotLoadTask* task : owned) {
+                    delete task;
+                }
+                // The retired registry is freed with the lambda, still on this thread
+            });
+            return;
+        }
+
+        size_t thread_count = 1;
+        if (mode == TEARDOWN_PARALLEL) {
+            thread_count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                            owned.size() / kTasksPerDeleteThread + 1);
+        }
+
+        size_t per_thread = (owned.size() + thread_count - 1) / thread_count;
+        auto delete_range = [&owned](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                delete owned[i];
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < thread_count; ++t) {
+            size_t first = std::min(owned.size(), t * per_thread);
+            threads.emplace_back(delete_range, first, std::min(owned.size(), first + per_thread));
+        }
+        delete_range(0, std::min(owned.size(), per_thread));
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void join_teardown() {
+        if (_teardown_thread.joinable()) {
+            _teardown_thread.join();
+        }
+    }
+
+    // After a mount or unmount a watched path may resolve to a different file
+    // system, or to nothing, while its old watch stays on a file that will
+    // never change again. Move such watches to what the paths refer to now,
+    // arm paths that became reachable and reload whatever differs.
+    // Caller must hold _mutex.
+    void revalidate_watches(PathList& changed_files, PathList& removed_files) {
+        std::pmr::vector<std::shared_ptr<HotInode>> moved(&_resource);
+        for (const auto& [id, inode] : _inodes) {
+            for (const auto& path : inode->paths) {
+                FileFingerprint fp = FileFingerprint::of(path.c_str());
+                if (!fp.valid() || fp.dev != inode->dev || fp.ino != inode->ino) {
+                    moved.push_back(inode);
+                    break;
+                }
+            }
+        }
+
+        for (const auto& inode : moved) {
+            rewatch_inode(inode, changed_files, removed_files);
+        }
+
+        for (auto& [file, watch] : _files) {
+            if (!watch.inode && std::filesystem::exists(file) && arm_watch(file, watch)) {
+                changed_files.push_back(file);
+            }
+        }
+
+        // Same inode but different content, e.g. a network file system failover
+        resync_fingerprints();
+    }
+
+    void restart_stopped_tasks() {
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+
+        PathList restarted_files(&_resource);
+        for (auto& [file, watch] : _files) {
+            // Check if the file came back since its watch was lost
+            if (!watch.inode && std::filesystem::exists(file) && arm_watch(file, watch)) {
+                restarted_files.push_back(file);
+            }
+        }
+
+        dispatch_changes(restarted_files);
+    }
+
+    // Caller must hold _mutex
+    int register_inotify_task(HotLoadTask* task, OwnerShip ownership, WatchMode mode) {
+        Path file = to_path(task->watch_file());
+
+        // Check if this exact task is already registered
+        auto it = _files.find(file);
+        if (it != _files.end()) {
+            for (const auto& task_info : it->second.tasks) {
+                if (task_info.task == task) {
+                    return -3; // Task already registered
+                }
+            }
+        }
+
+        // Register the file with inotify if not already watching
+        bool created = (it == _files.end());
+        if (created) {
+            it = _files.try_emplace(file).first;
+        }
+
+        // Add the task to the list, its mode decides how a new watch is armed
+        it->second.tasks.emplace_back(task, ownership, mode);
+
+        if (!it->second.inode && !arm_watch(file, it->second)) {
+            it->second.tasks.pop_back();
+            if (created) {
+                _files.erase(it);
+            }
+            return -4; // Failed to add watch
+        }
+
+        if (it->second.inode->oneshot && mode != WATCH_ONESHOT) {
+            make_persistent(*it->second.inode); // Every task of a oneshot inode must ask for it
+        }
+        std::atomic_store(&task->_inode, it->second.inode);
+
+        // Watch dependencies recorded before registration, e.g. by the constructor
+        commit_dependencies(task);
+
+        return 0; // Success
+    }
+
+    // Open an attribute file and wait for EPOLLPRI on it. The content is read
+    // once right away: sysfs and kernfs only notify after a read.
+    // Caller must hold _mutex.
+    int register_priority_task(HotLoadTask* task, OwnerShip ownership) {
+        Path file = to_path(task->watch_file());
+
+        auto it = _attributes.begin();
+        for (; it != _attributes.end(); ++it) {
+            if (it->second.path == file) {
+                break;
+            }
+        }
+
+        if (it == _attributes.end()) {
+            int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+            if (fd < 0) {
+                return -4; // Failed to open the attribute
+            }
+
+            std::string path(file.data(), file.size());
+            auto snapshot = FileSnapshot::read_fd(fd, path, 0);
+            if (!snapshot || !add_attribute_to_epoll(fd)) {
+                close(fd);
+                return -4; // Not readable or not pollable
+            }
+
+            std::pmr::polymorphic_allocator<HotInode> alloc(_resource.target);
+            auto inode = std::allocate_shared<HotInode>(alloc, _resource.target);
+            inode->dev = snapshot->fingerprint.dev;
+            inode->ino = snapshot->fingerprint.ino;
+            inode->fingerprint = snapshot->fingerprint;
+            inode->paths.push_back(file);
+            inode->store_snapshot(std::move(snapshot));
+
+            it = _attributes.try_emplace(fd).first;
+            it->second.path = file;
+            it->second.inode = std::move(inode);
+        } else {
+            for (const auto& task_info : it->second.tasks) {
+                if (task_info.task == task) {
+                    return -3; // Task already registered
+                }
+            }
+        }
+
+        it->second.tasks.emplace_back(task, ownership);
+        std::atomic_store(&task->_inode, it->second.inode);
+        commit_dependencies(task);
+
+        return 0; // Success
+    }
+
+    // Take a task out of the registry without deleting it, false if it is
+    // not registered. Caller must hold _mutex.
+    bool detach_task(HotLoadTask* task, OwnerShip& ownership) {
+        auto it = _files.find(to_path(task->watch_file()));
+        if (it == _files.end()) {
+            return detach_priority_task(task, ownership);
+        }
+
+        auto& task_list = it->second.tasks;
+        auto task_it = std::find_if(task_list.begin(), task_list.end(),
+            [task](const TaskInfo& info) { return info.task == task; });
+        if (task_it == task_list.end()) {
+            return detach_priority_task(task, ownership);
         }
 
-        _initialized.store(true); // Mark HotLoader as initialized
+        ownership = task_it->ownership;
+        task_list.erase(task_it);
+        std::atomic_store(&task->_inode, std::shared_ptr<HotInode>());
 
-        return 0;
+        // If nothing else needs this file, remove the inotify watch
+        release_if_unused(it);
+        release_dependencies(task);
+        forget_task(task);
+        return true;
     }
 
-    int register_task(HotLoadTask* task, OwnerShip ownership) {
-        if (!task) {
-            return -1; // Invalid task pointer
+    // Caller must hold _mutex
+    bool detach_priority_task(HotLoadTask* task, OwnerShip& ownership) {
+        for (auto it = _attributes.begin(); it != _attributes.end(); ++it) {
+            auto& task_list = it->second.tasks;
+            auto task_it = std::find_if(task_list.begin(), task_list.end(),
+                [task](const TaskInfo& info) { return info.task == task; });
+            if (task_it == task_list.end()) {
+                continue;
+            }
+
+            ownership = task_it->ownership;
+            task_list.erase(task_it);
+            if (task_list.empty()) {
+                close_attribute(it);
+            }
+
+            std::atomic_store(&task->_inode, std::shared_ptr<HotInode>());
+            release_dependencies(task);
+            forget_task(task);
+            return true;
         }
 
-        if (!_initialized.load()) {
-            return -2; // HotLoader not initialized
+        return false;
+    }
+
+    bool add_attribute_to_epoll(int fd) {
+        if (_epoll_fd < 0) {
+            return true; // Added once the event loop is recovered
         }
 
-        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+        struct epoll_event event;
+        event.events = EPOLLPRI | EPOLLERR | EPOLLET;
+        event.data.fd = fd;
+        return epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
 
-        const std::string& file = task->watch_file();
+    // Closing the fd also removes it from the epoll set. Caller must hold _mutex.
+    void close_attribute(AttributeMap::iterator it) {
+        close(it->first);
+        _attributes.erase(it);
+    }
 
-        // Check if this exact task is already registered
-        auto& task_list = _tasks[file];
-        for (const auto& task_info : task_list) {
-            if (task_info.task == task) {
-                return -3; // Task already registered
+    // Re-read attributes that signalled a change and reload their tasks.
+    // Caller must hold _mutex.
+    void dispatch_attributes(const std::pmr::vector<int>& fds) {
+        for (int fd : fds) {
+            auto it = _attributes.find(fd);
+            if (it == _attributes.end()) {
+                continue; // Unregistered meanwhile
             }
-        }
 
-        // Register the file with inotify if not already watching
-        int wd = -1;
-        if (!task_list.empty()) {
-            // File is already being watched, reuse the watch descriptor
-            wd = task_list[0].task->watch_descriptor();
-        } else {
-            // Need to create a new watch
-            wd = inotify_add_watch(_inotify_fd, file.c_str(), kWatchEventMask);
-            if (wd < 0) {
-                return -4; // Failed to add watch
+            HotInode& inode = *it->second.inode;
+            std::string path(it->second.path.data(), it->second.path.size());
+            auto snapshot = FileSnapshot::read_fd(fd, path, inode.generation.load() + 1);
+            if (!snapshot) {
+                continue;
             }
-        }
 
-        task->set_watch_descriptor(wd); // Set the watch descriptor in the task
+            inode.fingerprint = snapshot->fingerprint;
+            inode.store_snapshot(std::move(snapshot));
+            inode.generation.fetch_add(1, std::memory_order_release);
 
-        // Add the task to the list
-        task_list.emplace_back(task, ownership);
-        _watch_descriptors[wd] = file;
+            for (const auto& task_info : it->second.tasks) {
+                enqueue(task_info.task, CALLBACK_RELOAD);
+            }
+        }
 
-        return 0; // Success
+        run_queued();
     }
 
-    int unregister_task(HotLoadTask* task) {
-        if (!task) {
-            return -1; // Invalid task pointer
+    // Switch a oneshot inode to a regular watch. Adding a watch for a watched
+    // inode replaces its mask and keeps its wd. Caller must hold _mutex.
+    void make_persistent(HotInode& inode) {
+        inode.oneshot = false;
+        if (inode.wd >= 0) {
+            inotify_add_watch(_inotify_fd, inode.paths[0].c_str(), kWatchEventMask);
         }
+    }
 
-        if (!_initialized.load()) {
-            return -2; // HotLoader not initialized
+    // Arm the watches of oneshot inodes again once their reload is done, then
+    // catch writes that happened while no watch was armed by comparing
+    // fingerprints. Caller must hold _mutex.
+    void rearm_oneshot(const std::pmr::vector<std::shared_ptr<HotInode>>& inodes) {
+        PathList changed_files(&_resource);
+        PathList removed_files(&_resource);
+        for (const auto& inode : inodes) {
+            if (inode->wd >= 0 || inode->paths.empty()) {
+                continue; // Re-armed already, or no longer watched
+            }
+
+            int wd = inotify_add_watch(_inotify_fd, inode->paths[0].c_str(),
+                                       kWatchEventMask | (inode->oneshot ? IN_ONESHOT : 0));
+            FileFingerprint fp = FileFingerprint::of(inode->paths[0].c_str());
+            if (wd < 0 || fp.dev != inode->dev || fp.ino != inode->ino) {
+                if (wd >= 0) {
+                    inotify_rm_watch(_inotify_fd, wd); // Replaced meanwhile, watch the new inode instead
+                }
+                rewatch_inode(inode, changed_files, removed_files);
+                continue;
+            }
+
+            inode->wd = wd;
+            _watch_descriptors[wd] = inode;
+            if (fp != inode->fingerprint) {
+                changed_files.insert(changed_files.end(), inode->paths.begin(), inode->paths.end());
+            }
         }
 
-        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+        dispatch_changes(changed_files, removed_files);
+    }
 
-        const std::string& file = task->watch_file();
-        auto it = _tasks.find(file);
-        if (it == _tasks.end() || it->second.empty()) {
-            return -4; // Task not found
+    // Whether some path of the inode no longer refers to it, i.e. an attribute
+    // event was caused by an unlink or a rename over the path
+    bool is_unlinked(const HotInode& inode) {
+        for (const auto& file : inode.paths) {
+            FileFingerprint fp = FileFingerprint::of(file.c_str());
+            if (fp.dev != inode.dev || fp.ino != inode.ino) {
+                return true;
+            }
         }
+        return false;
+    }
 
-        auto& task_list = it->second;
+    // Drop the watch of an inode that went away and re-arm each of its paths
+    // on whatever inode it refers to now. Paths that exist again are added to
+    // changed_files, the others to removed_files. Caller must hold _mutex.
+    void rewatch_inode(const std::shared_ptr<HotInode>& inode,
+                       PathList& changed_files,
+                       PathList& removed_files) {
+        PathList paths(inode->paths.begin(), inode->paths.end(), &_resource);
+        for (const auto& file : paths) {
+            auto it = _files.find(file);
+            if (it != _files.end()) {
+                detach_watch(file, it->second);
+            }
+        }
 
-        // Find and remove the specific task
-        auto task_it = std::find_if(task_list.begin(), task_list.end(),
-            [task](const TaskInfo& info) { return info.task == task; });
+        for (const auto& file : paths) {
+            auto it = _files.find(file);
+            if (it == _files.end()) {
+                continue;
+            }
 
-        if (task_it == task_list.end()) {
-            return -4; // Task not found
+            // Missing files are picked up by restart_stopped_tasks() once recreated
+            if (std::filesystem::exists(file) && arm_watch(file, it->second)) {
+                changed_files.push_back(file);
+            } else {
+                removed_files.push_back(file);
+            }
         }
+    }
 
-        // Delete the task if HotLoader owns it
-        if (task_it->ownership == OWN_TASK) {
-            delete task;
+    // Call the reload callbacks of every task watching or depending on one of
+    // the files, each task at most once; a dependent hears of every changed
+    // dependency in that callback, see enqueue(). Tasks watching a removed file
+    // directly get on_remove(), its dependents get on_dependency_reload().
+    // Callbacks of tenants over their quota wait for a later pass. Returns
+    // the number of callbacks made. Caller must hold _mutex.
+    size_t dispatch_changes(const PathList& files, const PathList& removed_files = PathList()) {
+        if (files.empty() && removed_files.empty()) {
+            return 0;
         }
 
-        // Remove this task from the list
-        task_list.erase(task_it);
+        HotWave wave;
 
-        // If no more tasks for this file, remove the inotify watch
-        if (task_list.empty()) {
-            if (task->watch_descriptor() >= 0) {
-                inotify_rm_watch(_inotify_fd, task->watch_descriptor());
-                _watch_descriptors.erase(task->watch_descriptor());
+        // Start a new generation once per inode, aliases share its snapshot
+        std::pmr::unordered_set<HotInode*> bumped(&_resource);
+        for (const auto& file : files) {
+            auto it = _files.find(file);
+            if (it == _files.end() || !it->second.inode) {
+                continue;
+            }
+
+            HotInode* inode = it->second.inode.get();
+            if (bumped.insert(inode).second) {
+                inode->fingerprint = FileFingerprint::of(file.c_str());
+                inode->generation.fetch_add(1, std::memory_order_release);
             }
-            _tasks.erase(it);
         }
 
-        return 0; // Success
-    }
+        // Queue each task once, the callbacks run from the queues of their tenants
+        std::pmr::unordered_set<HotLoadTask*> queued(&_resource);
+        for (const auto& file : files) {
+            auto it = _files.find(file);
+            if (it == _files.end()) {
+                continue;
+            }
 
-    int unregister_task(const std::string& file) {
-        if (!_initialized.load()) {
-            return -2; // HotLoader not initialized
+            for (const auto& task_info : it->second.tasks) {
+                if (queued.insert(task_info.task).second) {
+                    enqueue(task_info.task, CALLBACK_RELOAD);
+                }
+            }
         }
 
-        std::string normalize_file = HotLoadTask::normalize_path(file);
-        if (normalize_file.empty()) {
-            return -3; // Invalid file path
+        auto notify_dependents = [&](const Path& file) {
+            auto it = _files.find(file);
+            if (it == _files.end()) {
+                return;
+            }
+
+            for (HotLoadTask* task : it->second.dependents) {
+                queued.insert(task);
+                enqueue(task, CALLBACK_DEPENDENCY, file); // Adds the file to a queued dependency callback
+            }
+        };
+
+        for (const auto& file : files) {
+            notify_dependents(file);
         }
 
-        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+        for (const auto& file : removed_files) {
+            auto it = _files.find(file);
+            if (it == _files.end()) {
+                continue;
+            }
 
-        auto it = _tasks.find(normalize_file);
-        if (it == _tasks.end() || it->second.empty()) {
-            return -4; // Task not found
+            for (const auto& task_info : it->second.tasks) {
+                if (queued.insert(task_info.task).second) {
+                    enqueue(task_info.task, CALLBACK_REMOVE);
+                }
+            }
         }
 
-        auto& task_list = it->second;
+        for (const auto& file : removed_files) {
+            notify_dependents(file);
+        }
 
-        // Remove all tasks for this file
-        for (const auto& task_info : task_list) {
-            HotLoadTask* task = task_info.task;
-            task->set_watch_descriptor(-1); // Reset the watch descriptor
+        return run_queued();
+    }
 
-            if (task_info.ownership == OWN_TASK) {
-                delete task; // Delete the task if HotLoader owns it
+    // Queue a callback with the tenant of its task. A task waits at most
+    // once: a newer reload or remove replaces what it waits for, a
+    // dependency change does not replace either. Dependency changes add up,
+    // so no changed file is lost while the task waits. Caller must hold _mutex.
+    void enqueue(HotLoadTask* task, CallbackKind kind, const Path& dependency = Path()) {
+        Tenant& tenant = tenant_of(task);
+
+        auto it = tenant.queued.find(task);
+        if (it != tenant.queued.end()) {
+            PendingCallback& callback = *it->second;
+            if (kind != CALLBACK_DEPENDENCY) {
+                callback.kind = kind;
+                callback.dependencies.clear();
+            } else if (callback.kind == CALLBACK_DEPENDENCY &&
+                       std::find(callback.dependencies.begin(), callback.dependencies.end(), dependency) ==
+                           callback.dependencies.end()) {
+                callback.dependencies.emplace_back(dependency);
             }
+            return;
         }
 
-        // Remove the inotify watch
-        if (!task_list.empty() && task_list[0].task->watch_descriptor() >= 0) {
-            int wd = task_list[0].task->watch_descriptor();
-            inotify_rm_watch(_inotify_fd, wd);
-            _watch_descriptors.erase(wd);
+        PathList dependencies(&_resource);
+        if (kind == CALLBACK_DEPENDENCY) {
+            dependencies.emplace_back(dependency);
+        }
+        tenant.pending.push_back(PendingCallback{task, kind, std::move(dependencies), _dispatch_round});
+        tenant.queued.emplace(task, std::prev(tenant.pending.end()));
+        if (!tenant.in_backlog) {
+            tenant.in_backlog = true;
+            _backlog.push_back(&tenant);
         }
+    }
 
-        _tasks.erase(it);
+    // Run queued callbacks round robin over the tenants, one per tenant and
+    // turn, so a tenant with many changes delays the others by at most one
+    // callback each. Tenants over their quota are passed over and keep their
+    // callbacks for a later pass. Returns the number of callbacks made.
+    // Caller must hold _mutex.
+    size_t run_queued() {
+        size_t calls = 0;
+        size_t reloads = 0;
+        size_t blocked = 0; // Tenants in a row that were over quota
+        while (!_backlog.empty() && blocked < _backlog.size()) {
+            Tenant* tenant = _backlog.front();
+            _backlog.pop_front();
+            if (tenant->pending.empty()) {
+                tenant->in_backlog = false; // Its tasks were unregistered meanwhile
+                continue;
+            }
 
-        return 0; // Success
-    }
+            refill(*tenant, Clock::now());
+            if (!within_quota(*tenant)) {
+                _backlog.push_back(tenant);
+                ++blocked;
+                continue;
+            }
+            blocked = 0;
+
+            PendingCallback callback = std::move(tenant->pending.front());
+            tenant->pending.pop_front();
+            tenant->queued.erase(callback.task);
+            if (tenant->pending.empty()) {
+                tenant->in_backlog = false;
+            } else {
+                _backlog.push_back(tenant);
+            }
 
-    int unregister_all_tasks() {
-        if (!_initialized.load()) {
-            return -1; // HotLoader not initialized
+            run_callback(*tenant, callback);
+            ++calls;
+            if (callback.kind != CALLBACK_REMOVE) {
+                ++reloads;
+            }
         }
 
-        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
-
-        for (auto& [file, task_list] : _tasks) {
-            for (const auto& task_info : task_list) {
-                HotLoadTask* task = task_info.task;
-                if (task->watch_descriptor() >= 0) {
-                    inotify_rm_watch(_inotify_fd, task->watch_descriptor());
-                    _watch_descriptors.erase(task->watch_descriptor());
-                }
+        ++_dispatch_round;
+        _metrics.reloads += reloads;
+        return calls;
+    }
 
-                if (task_info.ownership == OWN_TASK) {
-                    delete task; // Delete the task if HotLoader owns it
+    // Make one callback and charge it to the tenant. Caller must hold _mutex.
+    void run_callback(Tenant& tenant, const PendingCallback& callback) {
+        HotLoadTask* task = callback.task;
+        int64_t start = thread_cpu_time();
+
+        switch (callback.kind) {
+        case CALLBACK_RELOAD:
+            task->on_reload();
+            commit_dependencies(task);
+            break;
+        case CALLBACK_DEPENDENCY:
+            for (const auto& file : callback.dependencies) {
+                std::string path(file.data(), file.size());
+                if (!std::binary_search(task->_dependencies.begin(), task->_dependencies.end(), path)) {
+                    continue; // No longer a dependency after an earlier callback
                 }
+                task->on_dependency_reload(path);
+                commit_dependencies(task);
             }
+            break;
+        case CALLBACK_REMOVE:
+            task->on_remove();
+            break;
         }
 
-        _tasks.clear();
-        _watch_descriptors.clear();
-
-        return 0; // Success
+        int64_t used = thread_cpu_time() - start;
+        tenant.stats.callbacks++;
+        tenant.stats.cpu_time += std::chrono::nanoseconds(used);
+        if (tenant.limits.reloads_per_second > 0) {
+            tenant.tokens -= 1;
+        }
+        if (tenant.limits.cpu_per_second.count() > 0) {
+            tenant.cpu_credit -= static_cast<double>(used);
+        }
+        if (callback.round != _dispatch_round) {
+            tenant.stats.deferred++;
+            _metrics.deferred_reloads++;
+        }
     }
 
-    int run() {
-        if (_running.load()) {
-            return -1; // HotLoader already running
-        }
+    // Run callbacks that waited for tenant quota, as far as the quotas allow
+    // now. Returns how long the event loop may wait for events before the
+    // next of them is due. Called from the worker thread only.
+    int dispatch_deferred() {
+        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
 
-        if (!_initialized.load()) {
-            return -2; // HotLoader not initialized
+        if (_backlog.empty()) {
+            return kEpollTimeout;
         }
 
-        _running.store(true); // Set the running flag to true
+        HotWave wave;
+        run_queued();
 
-        _worker_thread = std::thread(std::bind(&HotLoader::work_loop, this));
+        double wait = kEpollTimeout / 1000.0;
+        for (const Tenant* tenant : _backlog) {
+            wait = std::min(wait, quota_wait(*tenant));
+        }
+        return static_cast<int>(wait * 1000) + 1;
+    }
 
-        return 0; // Success
+    // Tenant of a registered task. Caller must hold _mutex.
+    Tenant& tenant_of(HotLoadTask* task) {
+        return _tenants.try_emplace(to_path(task->_tenant), &_resource).first->second;
     }
 
-    void stop() {
-        _running.store(false); // Set the running flag to false
-        
-        if (_worker_thread.joinable()) {
-            _worker_thread.join(); // Wait for the worker thread to finish
+    // Drop a task from its tenant together with a callback it still waits
+    // for. Caller must hold _mutex.
+    void forget_task(HotLoadTask* task) {
+        auto it = _tenants.find(to_path(task->_tenant));
+        if (it == _tenants.end()) {
+            return;
         }
 
-        unregister_all_tasks(); // Unregister all tasks
-    }
+        Tenant& tenant = it->second;
+        if (tenant.tasks.erase(task) != 0) {
+            tenant.watches--;
+        }
 
-private:
-    HotLoader() = default;
-    HotLoader(const HotLoader&) = delete;
-    HotLoader& operator=(const HotLoader&) = delete;
-    HotLoader(HotLoader&&) = delete;
-    HotLoader& operator=(HotLoader&&) = delete;
+        auto queued = tenant.queued.find(task);
+        if (queued != tenant.queued.end()) {
+            tenant.pending.erase(queued->second);
+            tenant.queued.erase(queued);
+        }
+    }
 
-    ~HotLoader() {
-        stop();
-        close_file_descriptors();
+    // New limits start with full buckets
+    static void set_limits(Tenant& tenant, const HotTenantLimits& limits) {
+        tenant.limits = limits;
+        tenant.tokens = reload_burst(limits);
+        tenant.cpu_credit = cpu_budget(limits);
+        tenant.refilled = Clock::now();
     }
 
-    void close_file_descriptors() {
-        if (_inotify_fd >= 0) {
-            close(_inotify_fd);
-            _inotify_fd = -1;
+    // Top up the quota buckets for the time since the last refill, each
+    // holding at most one burst or one second of CPU time
+    static void refill(Tenant& tenant, Clock::time_point now) {
+        double seconds = std::chrono::duration<double>(now - tenant.refilled).count();
+        tenant.refilled = now;
+
+        const HotTenantLimits& limits = tenant.limits;
+        if (limits.reloads_per_second > 0) {
+            tenant.tokens = std::min(reload_burst(limits), tenant.tokens + seconds * limits.reloads_per_second);
         }
-        if (_epoll_fd >= 0) {
-            close(_epoll_fd);
-            _epoll_fd = -1;
+        if (limits.cpu_per_second.count() > 0) {
+            tenant.cpu_credit = std::min(cpu_budget(limits), tenant.cpu_credit + seconds * cpu_budget(limits));
         }
     }
 
-    void work_loop() {
-        static struct epoll_event events[kMaxEventCount];
-        static char event_buf[kEventBufferSize];
-
-        while (_running.load()) {
-            restart_stopped_tasks();
+    static bool within_quota(const Tenant& tenant) {
+        return (tenant.limits.reloads_per_second <= 0 || tenant.tokens >= 1) &&
+               (tenant.limits.cpu_per_second.count() <= 0 || tenant.cpu_credit > 0);
+    }
 
-            int n_ready = epoll_wait(_epoll_fd, events, kMaxEventCount, kEpollTimeout);
-            if (n_ready < 0) {
-                if (errno == EINTR) {
-                    continue; // Interrupted, retry
-                }
+    // Seconds until within_quota() holds again
+    static double quota_wait(const Tenant& tenant) {
+        double wait = 0;
+        if (tenant.limits.reloads_per_second > 0 && tenant.tokens < 1) {
+            wait = (1 - tenant.tokens) / tenant.limits.reloads_per_second;
+        }
+        if (tenant.limits.cpu_per_second.count() > 0 && tenant.cpu_credit <= 0) {
+            wait = std::max(wait, -tenant.cpu_credit / cpu_budget(tenant.limits));
+        }
+        return wait;
+    }
 
-                perror("epoll_wait failed");
-                stop();
-                return; // Error occurred
-            }
+    static double reload_burst(const HotTenantLimits& limits) {
+        return std::max(1.0, limits.reload_burst > 0 ? limits.reload_burst : limits.reloads_per_second);
+    }
 
-            if (n_ready == 0) {
-                continue; // No events ready, continue the loop
-            }
+    // CPU nanoseconds per second
+    static double cpu_budget(const HotTenantLimits& limits) {
+        return std::chrono::duration<double, std::nano>(limits.cpu_per_second).count();
+    }
 
-            std::unordered_map<int, uint32_t> event_masks;
+    static int64_t thread_cpu_time() {
+        struct timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
 
-            for (int i = 0; i < n_ready; ++i) {
-                if (events[i].data.fd == _inotify_fd) {
-                    while (true) {
-                        ssize_t len = read(_inotify_fd, event_buf, kEventBufferSize);
-                        if (len < 0) {
-                            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                                break; // No more events or interrupted, break the loop
-                            } else if (errno == EINTR) {
-                                continue; // Interrupted, retry reading
-                            }
+    // Attach a path to the watch of the inode it refers to, adding the
+    // inotify watch if no other path shares that inode. Caller must hold _mutex.
+    bool arm_watch(const Path& file, FileWatch& watch) {
+        FileFingerprint fp = FileFingerprint::of(file.c_str());
+        if (!fp.valid()) {
+            return false;
+        }
 
-                            perror("read inotify events");
-                            stop();
-                            return; // Error occurred
-                        }
+        bool oneshot = !watch.tasks.empty() && std::all_of(watch.tasks.begin(), watch.tasks.end(),
+            [](const TaskInfo& info) { return info.mode == WATCH_ONESHOT; });
 
-                        for (char* ptr = event_buf; ptr < event_buf + len;) {
-                            struct inotify_event* event = reinterpret_cast<struct inotify_event*>(ptr);
-                            ptr += sizeof(struct inotify_event) + event->len;
+        std::shared_ptr<HotInode>& inode = _inodes[FileId{fp.dev, fp.ino}];
+        if (inode && inode->oneshot && !oneshot) {
+            make_persistent(*inode);
+        }
 
-                            event_masks[event->wd] |= event->mask; // Aggregate event masks
-                        }
-                    }
-                }
+        if (!inode) {
+            int wd = inotify_add_watch(_inotify_fd, file.c_str(), kWatchEventMask | (oneshot ? IN_ONESHOT : 0));
+            if (wd < 0) {
+                _inodes.erase(FileId{fp.dev, fp.ino});
+                return false;
             }
 
-            // Process the aggregated events
-            std::lock_guard<std::mutex> lock(_mutex); // Lock to ensure thread safety
-
-            for (const auto& [wd, mask] : event_masks) {
-                auto it = _watch_descriptors.find(wd);
-                if (it != _watch_descriptors.end()) {
-                    const std::string& file = it->second;
-                    auto task_it = _tasks.find(file);
-                    if (task_it != _tasks.end()) {
-                        for (const auto& task_info : task_it->second) {
-                            HotLoadTask* task = task_info.task;
-
-                            if (mask & IN_IGNORED) {
-                                rewatch_task(task);
-                            } else {
-                                task->on_reload();
-                            }
-                        }
-                    }
-                }
+            std::pmr::polymorphic_allocator<HotInode> alloc(_resource.target);
+            inode = std::allocate_shared<HotInode>(alloc, _resource.target);
+            inode->dev = fp.dev;
+            inode->ino = fp.ino;
+            inode->wd = wd;
+            inode->oneshot = oneshot;
+            inode->fingerprint = fp;
+            _watch_descriptors[wd] = inode;
+
+            // Continue from what the predecessor dispatched last, the resync in
+            // finish_adoption() reloads the file if it changed since
+            auto adopted = _adopted.find(file);
+            if (adopted != _adopted.end()) {
+                inode->fingerprint = adopted->second.fingerprint;
+                inode->generation.store(adopted->second.generation);
             }
         }
+
+        inode->paths.push_back(file);
+        watch.inode = inode;
+        for (const auto& task_info : watch.tasks) {
+            std::atomic_store(&task_info.task->_inode, inode);
+        }
+        return true;
     }
 
-    void restart_stopped_tasks() {
-        std::lock_guard<std::mutex> lock(_mutex); // Ensure thread safety
+    // Detach a path from its inode, removing the inotify watch when no other
+    // path refers to the inode anymore. Caller must hold _mutex.
+    void detach_watch(const Path& file, FileWatch& watch) {
+        if (!watch.inode) {
+            return;
+        }
 
-        for (auto& [file, task_list] : _tasks) {
-            if (task_list.empty()) {
-                continue;
-            }
+        std::shared_ptr<HotInode> inode = std::move(watch.inode);
+        for (const auto& task_info : watch.tasks) {
+            std::atomic_store(&task_info.task->_inode, std::shared_ptr<HotInode>());
+        }
 
-            // Check if any task needs restart
-            if (task_list[0].task->watch_descriptor() < 0 &&
-                std::filesystem::exists(file)) {
+        auto& paths = inode->paths;
+        paths.erase(std::remove(paths.begin(), paths.end(), file), paths.end());
+        if (!paths.empty()) {
+            return; // Still watched through another path
+        }
 
-                // Tasks are stopped, try to restart them
-                int wd = inotify_add_watch(_inotify_fd, file.c_str(),
-                                        kWatchEventMask);
-                if (wd >= 0) {
-                    for (const auto& task_info : task_list) {
-                        task_info.task->on_reload();
-                        task_info.task->set_watch_descriptor(wd);
-                    }
-                    _watch_descriptors[wd] = file;
-                }
+        if (inode->wd >= 0) {
+            if (!_handed_off) {
+                inotify_rm_watch(_inotify_fd, inode->wd); // The watch belongs to the successor after a handoff
             }
+            _watch_descriptors.erase(inode->wd);
+        }
+
+        auto it = _inodes.find(FileId{inode->dev, inode->ino});
+        if (it != _inodes.end() && it->second == inode) {
+            _inodes.erase(it);
         }
     }
 
-    void rewatch_task(HotLoadTask* task) {
-        if (!task) {
+    // Drop the watch of a file nobody is interested in anymore. Caller must hold _mutex.
+    void release_if_unused(FileMap::iterator it) {
+        FileWatch& watch = it->second;
+        if (!watch.tasks.empty() || !watch.dependents.empty()) {
             return;
         }
 
-        const std::string& file = task->watch_file();
+        detach_watch(it->first, watch);
+        _files.erase(it);
+    }
 
-        // Find all tasks for this file
-        auto it = _tasks.find(file);
-        if (it == _tasks.end() || it->second.empty()) {
-            return;
+    // Replace the watched dependencies of a task with the ones it tracked
+    // since the last reload. Caller must hold _mutex.
+    void commit_dependencies(HotLoadTask* task) {
+        std::vector<std::string> next;
+        next.swap(task->_tracked_dependencies);
+        std::sort(next.begin(), next.end());
+
+        std::vector<std::string>& current = task->_dependencies;
+        std::vector<std::string> removed;
+        std::vector<std::string> added;
+        std::set_difference(current.begin(), current.end(), next.begin(), next.end(),
+                            std::back_inserter(removed));
+        std::set_difference(next.begin(), next.end(), current.begin(), current.end(),
+                            std::back_inserter(added));
+
+        for (const auto& file : removed) {
+            release_dependency(file, task);
         }
 
-        auto& task_list = it->second;
+        Tenant& tenant = tenant_of(task);
+        tenant.watches -= removed.size();
 
-        // Remove old watch
-        if (task_list[0].task->watch_descriptor() >= 0) {
-            inotify_rm_watch(_inotify_fd, task_list[0].task->watch_descriptor());
-            _watch_descriptors.erase(task_list[0].task->watch_descriptor());
-        }
+        for (const auto& file : added) {
+            if (tenant.limits.max_watches != 0 && tenant.watches >= tenant.limits.max_watches) {
+                tenant.stats.rejected_watches++; // Not watched, and not kept as a dependency
+                next.erase(std::lower_bound(next.begin(), next.end(), file));
+                continue;
+            }
+            tenant.watches++;
 
-        if (!std::filesystem::exists(file)) {
-            // Reset all watch descriptors if file does not exist
-            for (const auto& task_info : task_list) {
-                task_info.task->set_watch_descriptor(-1);
+            auto it = _files.try_emplace(to_path(file)).first;
+            it->second.dependents.push_back(task);
+
+            // Missing dependencies are picked up later by restart_stopped_tasks()
+            if (!it->second.inode && std::filesystem::exists(file)) {
+                arm_watch(it->first, it->second);
             }
-            return;
         }
 
-        // Add new watch
-        int wd = inotify_add_watch(_inotify_fd, file.c_str(),
-                                kWatchEventMask);
-        if (wd >= 0) {
-            for (const auto& task_info : task_list) {
-                task_info.task->on_reload();
-                task_info.task->set_watch_descriptor(wd);
-            }
-            _watch_descriptors[wd] = file;
-        } else {
-            // Reset all watch descriptors if rewatch fails
-            for (const auto& task_info : task_list) {
-                task_info.task->set_watch_descriptor(-1);
-            }
+        current = std::move(next);
+    }
+
+    Path to_path(const std::string& file) {
+        return Path(file.data(), file.size(), &_resource);
+    }
+
+    void release_dependencies(HotLoadTask* task) {
+        for (const auto& file : task->_dependencies) {
+            release_dependency(file, task);
         }
+        tenant_of(task).watches -= task->_dependencies.size();
+
+        task->_dependencies.clear();
+        task->_tracked_dependencies.clear();
     }
 
-private:
-    struct TaskInfo {
-        HotLoadTask* task;
-        OwnerShip ownership;
+    void release_dependency(const std::string& file, HotLoadTask* task) {
+        auto it = _files.find(to_path(file));
+        if (it == _files.end()) {
+            return;
+        }
 
-        TaskInfo(HotLoadTask* t, OwnerShip o) : task(t), ownership(o) {}
-        TaskInfo() : task(nullptr), ownership(DOESNT_OWN_TASK) {}
-    };
+        auto& dependents = it->second.dependents;
+        dependents.erase(std::remove(dependents.begin(), dependents.end(), task), dependents.end());
+        release_if_unused(it);
+    }
 
+private:
     std::mutex _mutex; // Mutex to protect access to shared resources
-    std::unordered_map<std::string, std::vector<TaskInfo>> _tasks; // Maps file paths to multiple HotLoadTask pointers
-    std::unordered_map<int, std::string> _watch_descriptors; // Maps inotify watch descriptors to file paths
+    ForwardingResource _resource; // Memory resource of the registry, see set_memory_resource()
+    FileMap _files{&_resource}; // Maps file paths to their tasks, dependents and inode
+    InodeMap _inodes{&_resource}; // Maps (dev, inode) to the watch shared by its paths
+    WatchDescriptorMap _watch_descriptors{&_resource}; // Maps inotify watch descriptors to inodes
+    AttributeMap _attributes{&_resource}; // Maps attribute fds to their tasks, see WATCH_PRIORITY
+    std::pmr::unordered_map<Path, AdoptedInode> _adopted{&_resource}; // Registry of the predecessor until run(), see adopt()
+    HotLoaderMetrics _metrics; // Event loop health counters
     int _inotify_fd = -1; // File descriptor for inotify
     int _epoll_fd = -1;   // File descriptor for epoll
+    int _mountinfo_fd = -1; // /proc/self/mountinfo, signals mount table changes
+    int _wake_fd = -1;      // eventfd written by stop() to interrupt epoll_wait()
     std::atomic<bool> _initialized = false; // Flag to indicate if HotLoader is initialized
     std::atomic<bool> _running = false; // Flag to control the running state
+    bool _handed_off = false; // Watches belong to a successor process, see handoff()
     std::thread _worker_thread; // Worker thread for monitoring file changes
-};
\ No newline at end of file
+    std::thread _teardown_thread; // Deletes tasks after unregister_all_tasks(TEARDOWN_DEFERRED)
+    TenantMap _tenants{&_resource}; // Tenant namespaces by name, "" is the default one
+    std::pmr::deque<Tenant*> _backlog{&_resource}; // Tenants with queued callbacks, in turn order
+    uint64_t _dispatch_round = 0; // Number of run_queued() passes, tells deferred callbacks apart
+};
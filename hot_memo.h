@@ -0,0 +1,533 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+#include "hot_loader.h"
+
+enum HotMemoMode {
+    MEMO_LAZY, // Recomputed by the next get() after an input changed
+    MEMO_EAGER // Recomputed in the background as soon as an input changed
+};
+
+class HotMemoNode;
+class HotMemoContext;
+
+template <typename T>
+class HotMemo;
+
+// Background thread recomputing eager memo entries after an invalidation.
+// Invalidations arrive on the loader thread, which must not compute: a
+// computation registers watches for the files it reads.
+class HotMemoRefresher {
+public:
+    static HotMemoRefresher& instance() {
+        static HotMemoRefresher instance;
+        return instance;
+    }
+
+    void schedule(std::weak_ptr<HotMemoNode> node) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(std::move(node));
+        if (!_thread.joinable()) {
+            _thread = std::thread(&HotMemoRefresher::run, this);
+        }
+        _cv.notify_one();
+    }
+
+    ~HotMemoRefresher() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopped = true;
+        }
+        _cv.notify_one();
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+private:
+    HotMemoRefresher() = default;
+
+    void run();
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<std::weak_ptr<HotMemoNode>> _queue; // Entries whose owner may be gone meanwhile
+    std::thread _thread;
+    bool _stopped = false;
+};
+
+// Type-erased memo entry, see HotMemo. Readers take the cached value
+// lock-free while it is fresh; a stale entry is recomputed by one thread
+// while the others wait. Invalidation only flips flags and walks the
+// downstream entries, which is safe from the loader thread.
+class HotMemoNode : public std::enable_shared_from_this<HotMemoNode> {
+public:
+    using Compute = std::function<std::shared_ptr<const void>(HotMemoContext& context)>;
+
+    HotMemoNode(Compute compute, HotMemoMode mode, HotLoader& loader)
+        : _compute(std::move(compute)), _mode(mode), _loader(loader) {}
+
+    HotMemoNode(const HotMemoNode&) = delete;
+    HotMemoNode& operator=(const HotMemoNode&) = delete;
+
+    ~HotMemoNode();
+
+    // Wait for a running computation and stop watching. The refresher or an
+    // entry downstream may keep the node alive; it returns its last value
+    // from now on.
+    void close();
+
+    // Current value, recomputed first if an input changed
+    std::shared_ptr<const void> get();
+
+    // Mark the entry and everything computed from it stale. A forced entry
+    // is recomputed even if its inputs look the same.
+    void invalidate(bool forced = false);
+
+    bool fresh() const {
+        return _fresh.load(std::memory_order_acquire);
+    }
+
+    uint64_t version() const {
+        return _version.load(std::memory_order_acquire);
+    }
+
+    std::vector<std::string> inputs() {
+        std::lock_guard<std::mutex> lock(_compute_mutex);
+        std::vector<std::string> paths;
+        for (const auto& input : _inputs) {
+            paths.push_back(input.path);
+        }
+        return paths;
+    }
+
+private:
+    friend class HotMemoContext;
+    friend class HotMemoRefresher;
+
+    // Watch of the files read by one computation. It is anchored at one of
+    // them that exists and tracks all the others as dependencies, so the
+    // loader re-arms those that do not exist yet once they appear.
+    class InputTask : public HotLoadTask {
+    public:
+        InputTask(const std::string& anchor, std::vector<std::string> files, HotMemoNode& node)
+            : HotLoadTask(anchor), _files(std::move(files)), _node(node) {
+            track_files();
+        }
+
+        void on_reload() override {
+            _node.invalidate();
+            track_files();
+        }
+
+        void on_dependency_reload(const std::string&) override {
+            _node.invalidate();
+            track_files();
+        }
+
+        void on_remove() override {
+            _node.invalidate();
+        }
+
+    private:
+        void track_files() {
+            for (const auto& file : _files) {
+                track_dependency(file); // The anchor itself is skipped
+            }
+        }
+
+        const std::vector<std::string> _files;
+        HotMemoNode& _node;
+    };
+
+    struct Input {
+        std::string path;
+        bool exists = false;
+        uint64_t hash = 0; // hot_hash64 of the content read
+    };
+
+    struct Upstream {
+        std::shared_ptr<HotMemoNode> node;
+        uint64_t version = 0; // Version read by the last computation
+    };
+
+    // Recompute unless every input still hashes the same and every upstream
+    // entry is at the version read last time. Caller must hold _compute_mutex.
+    void refresh();
+
+    bool unchanged();
+
+    bool inputs_unchanged() const;
+
+    // Watch the inputs of the last computation. Null if none of them exists
+    // or the loader is not running.
+    std::unique_ptr<InputTask> watch() {
+        std::vector<std::string> files;
+        std::string anchor;
+        for (const auto& input : _inputs) {
+            files.push_back(input.path);
+            if (anchor.empty() && input.exists) {
+                anchor = input.path;
+            }
+        }
+        if (anchor.empty() || !_loader.running()) {
+            return nullptr; // Registered but not running would never report a change
+        }
+
+        auto task = std::make_unique<InputTask>(anchor, std::move(files), *this);
+        if (task->watch_file().empty() || _loader.register_task(task.get(), HotLoader::DOESNT_OWN_TASK) != 0) {
+            return nullptr;
+        }
+        return task;
+    }
+
+    void unwatch() {
+        if (_watch) {
+            _loader.unregister_task(_watch.get());
+            _watch.reset();
+        }
+    }
+
+    void link(HotMemoNode* downstream) {
+        std::lock_guard<std::mutex> lock(_links_mutex);
+        if (std::find(_downstream.begin(), _downstream.end(), downstream) == _downstream.end()) {
+            _downstream.push_back(downstream);
+        }
+    }
+
+    void unlink(HotMemoNode* downstream) {
+        std::lock_guard<std::mutex> lock(_links_mutex);
+        _downstream.erase(std::remove(_downstream.begin(), _downstream.end(), downstream), _downstream.end());
+    }
+
+private:
+    const Compute _compute;
+    const HotMemoMode _mode;
+    HotLoader& _loader;
+
+    std::mutex _compute_mutex;              // One computation at a time, guards the inputs
+    std::shared_ptr<const void> _value;     // Accessed with atomic_load/atomic_store
+    std::atomic<bool> _fresh{false};
+    std::atomic<bool> _computing{false};
+    std::atomic<bool> _scheduled{false};    // Queued with the refresher
+    std::atomic<bool> _forced{false};       // Skip the comparison with the last inputs
+    std::atomic<uint64_t> _stamp{0};        // Bumped by every invalidation
+    std::atomic<uint64_t> _version{0};      // Number of computations
+    bool _resolved = false;                 // Every file read by the last computation has a path
+    bool _closed = false;
+    std::vector<Input> _inputs;
+    std::unique_ptr<InputTask> _watch;
+    std::vector<Upstream> _upstream;
+
+    std::mutex _links_mutex;
+    std::vector<HotMemoNode*> _downstream;  // Entries that read this one, unlink themselves on destruction
+};
+
+// What a computation reads. Files read here and other entries read with
+// get() become inputs of the entry being computed; when one of them
+// changes the entry is invalidated, and entries computed from it in turn.
+class HotMemoContext {
+public:
+    explicit HotMemoContext(HotMemoNode& node)
+        : _node(node) {}
+
+    HotMemoContext(const HotMemoContext&) = delete;
+    HotMemoContext& operator=(const HotMemoContext&) = delete;
+
+    // Drop the links the entry no longer reads through: those of a
+    // computation that threw, or of the previous one after a computation
+    // completed and swapped its upstream entries in
+    ~HotMemoContext() {
+        for (const auto& upstream : _upstream) {
+            bool kept = std::any_of(_node._upstream.begin(), _node._upstream.end(),
+                                    [&upstream](const HotMemoNode::Upstream& entry) { return entry.node == upstream.node; });
+            if (!kept) {
+                upstream.node->unlink(&_node);
+            }
+        }
+    }
+
+    // Content of a file, null if it does not exist
+    std::shared_ptr<const FileSnapshot> read(const std::string& file) {
+        std::string path = HotLoadTask::absolute_path(file);
+        if (path.empty()) {
+            _resolved = false; // Cannot be watched
+            return FileSnapshot::read(file, 0);
+        }
+
+        auto it = std::find_if(_inputs.begin(), _inputs.end(),
+                               [&path](const HotMemoNode::Input& input) { return input.path == path; });
+        if (it == _inputs.end()) {
+            it = _inputs.insert(_inputs.end(), HotMemoNode::Input{path, false, 0});
+        }
+
+        std::shared_ptr<const FileSnapshot> content = FileSnapshot::read(path, 0);
+        it->exists = (content != nullptr);
+        it->hash = content ? hot_hash64(content->data.data(), content->data.size()) : 0;
+        return content;
+    }
+
+    // Value of another entry, computed first if stale
+    template <typename U>
+    std::shared_ptr<const U> get(const HotMemo<U>& memo) {
+        return std::static_pointer_cast<const U>(get(memo._node));
+    }
+
+private:
+    friend class HotMemoNode;
+
+    std::shared_ptr<const void> get(const std::shared_ptr<HotMemoNode>& upstream) {
+        // Recorded and linked before reading, so an invalidation after the
+        // read reaches this entry and the link is dropped if the read throws
+        auto it = std::find_if(_upstream.begin(), _upstream.end(),
+                               [&upstream](const HotMemoNode::Upstream& entry) { return entry.node == upstream; });
+        if (it == _upstream.end()) {
+            it = _upstream.insert(_upstream.end(), HotMemoNode::Upstream{upstream, 0});
+            upstream->link(&_node);
+        }
+
+        std::shared_ptr<const void> value = upstream->get();
+        it->version = upstream->version();
+        return value;
+    }
+
+    HotMemoNode& _node;
+    std::vector<HotMemoNode::Input> _inputs;
+    std::vector<HotMemoNode::Upstream> _upstream;
+    bool _resolved = true;
+};
+
+// A derived value computed from files and from other memo entries, cached
+// until one of its inputs changes. The computation receives a
+// HotMemoContext and reads everything it depends on through it; the set of
+// inputs is recorded anew on every computation, so it may differ from one
+// version to the next. Changes are reported by the HotLoader, no input is
+// polled. Files that do not exist yet are watched too, once at least one
+// file read exists; an entry that cannot be watched, e.g. while the loader
+// is not running, stays stale.
+//
+// A stale entry first compares the content hash of every input file and the
+// version of every upstream entry with what the last computation read, and
+// keeps its value if nothing really changed, e.g. after a touch. Entries
+// must not read each other in a cycle, must outlive the entries reading
+// them, and get() must not be called from a reload callback.
+template <typename T>
+class HotMemo {
+public:
+    using Compute = std::function<std::shared_ptr<const T>(HotMemoContext& context)>;
+
+    // An eager entry is computed here, a lazy one by the first get()
+    explicit HotMemo(Compute compute, HotMemoMode mode = MEMO_LAZY, HotLoader& loader = HotLoader::instance())
+        : _node(std::make_shared<HotMemoNode>(
+              [compute = std::move(compute)](HotMemoContext& context) -> std::shared_ptr<const void> {
+                  return compute(context);
+              },
+              mode, loader)) {
+        if (mode == MEMO_EAGER) {
+            _node->get();
+        }
+    }
+
+    HotMemo(const HotMemo&) = delete;
+    HotMemo& operator=(const HotMemo&) = delete;
+
+    ~HotMemo() {
+        _node->close();
+    }
+
+    // Current value, computed first if stale. Exceptions of the computation
+    // propagate; the previous value is kept.
+    std::shared_ptr<const T> get() const {
+        return std::static_pointer_cast<const T>(_node->get());
+    }
+
+    // Whether get() would return the cached value without computing
+    bool fresh() const {
+        return _node->fresh();
+    }
+
+    // Number of computations so far
+    uint64_t version() const {
+        return _node->version();
+    }
+
+    // Force a recomputation, e.g. after a change the computation cannot see
+    void invalidate() {
+        _node->invalidate(true);
+    }
+
+    // Files read by the last computation
+    std::vector<std::string> inputs() const {
+        return _node->inputs();
+    }
+
+private:
+    friend class HotMemoContext;
+
+    std::shared_ptr<HotMemoNode> _node;
+};
+
+inline HotMemoNode::~HotMemoNode() {
+    // Once unregistered no callback can reach this entry anymore
+    unwatch();
+    for (auto& upstream : _upstream) {
+        upstream.node->unlink(this);
+    }
+}
+
+inline void HotMemoNode::close() {
+    std::lock_guard<std::mutex> lock(_compute_mutex);
+    _closed = true;
+    unwatch();
+    for (auto& upstream : _upstream) {
+        upstream.node->unlink(this);
+    }
+    _upstream.clear();
+}
+
+inline std::shared_ptr<const void> HotMemoNode::get() {
+    // Watches end with stop(): compare the inputs again on every call
+    if (!_fresh.load(std::memory_order_acquire) || !_loader.running()) {
+        std::lock_guard<std::mutex> lock(_compute_mutex);
+        if ((!_fresh.load(std::memory_order_acquire) || !_loader.running()) && !_closed) {
+            refresh();
+        }
+    }
+    return std::atomic_load(&_value);
+}
+
+inline void HotMemoNode::invalidate(bool forced) {
+    if (forced) {
+        _forced.store(true, std::memory_order_release);
+    }
+    _stamp.fetch_add(1, std::memory_order_acq_rel);
+    bool was_fresh = _fresh.exchange(false, std::memory_order_acq_rel);
+    if (!was_fresh && !_computing.load(std::memory_order_acquire)) {
+        return; // Already stale, and so is everything computed from it
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_links_mutex);
+        for (HotMemoNode* downstream : _downstream) {
+            downstream->invalidate();
+        }
+    }
+
+    if (_mode == MEMO_EAGER && !_scheduled.exchange(true, std::memory_order_acq_rel)) {
+        HotMemoRefresher::instance().schedule(weak_from_this());
+    }
+}
+
+inline void HotMemoNode::refresh() {
+    uint64_t stamp = _stamp.load(std::memory_order_acquire);
+    _computing.store(true, std::memory_order_release);
+
+    struct Done {
+        std::atomic<bool>& computing;
+        ~Done() {
+            computing.store(false, std::memory_order_release);
+        }
+    } done{_computing};
+
+    if (_forced.exchange(false, std::memory_order_acq_rel) || !unchanged()) {
+        HotMemoContext context(*this);
+        std::shared_ptr<const void> value = _compute(context);
+
+        unwatch();
+        _inputs.swap(context._inputs);
+        _upstream.swap(context._upstream); // The context unlinks the entries no longer read
+
+        _resolved = context._resolved;
+        std::atomic_store(&_value, std::move(value));
+        _version.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // The files are watched after they were read: one that changed in
+    // between no longer matches its hash and keeps the entry stale. Files
+    // that could not be watched last time are tried again.
+    bool watched = _resolved;
+    if (!_loader.running()) {
+        unwatch();
+    }
+    if (!_inputs.empty() && !_watch) {
+        _watch = watch();
+        watched = watched && _watch && inputs_unchanged();
+    }
+    for (const auto& upstream : _upstream) {
+        watched = watched && upstream.node->fresh(); // Otherwise its changes might not reach this entry
+    }
+
+    // Changed while computing: the value is returned once but stays stale
+    if (watched && _stamp.load(std::memory_order_acquire) == stamp) {
+        _fresh.store(true, std::memory_order_release);
+    }
+}
+
+inline bool HotMemoNode::unchanged() {
+    if (_version.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+
+    if (!inputs_unchanged()) {
+        return false;
+    }
+
+    for (const auto& upstream : _upstream) {
+        upstream.node->get();
+        if (upstream.node->version() != upstream.version) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool HotMemoNode::inputs_unchanged() const {
+    for (const auto& input : _inputs) {
+        std::shared_ptr<const FileSnapshot> content = FileSnapshot::read(input.path, 0);
+        if ((content != nullptr) != input.exists) {
+            return false;
+        }
+        if (content && hot_hash64(content->data.data(), content->data.size()) != input.hash) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void HotMemoRefresher::run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _cv.wait(lock, [this]() { return _stopped || !_queue.empty(); });
+        if (_stopped) {
+            return;
+        }
+
+        std::weak_ptr<HotMemoNode> weak = std::move(_queue.front());
+        _queue.pop_front();
+        lock.unlock();
+
+        // An entry destroyed meanwhile is skipped; one released here is
+        // destroyed on this thread, never on the loader thread
+        if (std::shared_ptr<HotMemoNode> node = weak.lock()) {
+            node->_scheduled.store(false, std::memory_order_release);
+            try {
+                node->get();
+            } catch (...) {
+                // Stays stale, the next get() reports the failure
+            }
+        }
+
+        lock.lock();
+    }
+}
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "hot_loader.h"
+
+// NUMA topology and memory placement straight from sysfs and system calls,
+// without libnuma. On a machine without NUMA support everything reports a
+// single node 0.
+class HotNuma {
+public:
+    constexpr static int kMaxNodes = 1024;
+
+    // Number of possible node ids, i.e. highest online node + 1
+    static int node_count() {
+        static const int count = [] {
+            std::vector<int> nodes = parse_list(read_line("/sys/devices/system/node/online"));
+            return nodes.empty() ? 1 : std::min(kMaxNodes, nodes.back() + 1);
+        }();
+        return count;
+    }
+
+    // Node of the CPU the calling thread runs on
+    static int current_node() {
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+            return 0;
+        }
+        return static_cast<int>(node);
+    }
+
+    static std::vector<int> node_cpus(int node) {
+        return parse_list(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    }
+
+    // Restrict the calling thread to the CPUs of a node. Returns 0 or -errno.
+    static int pin_thread(int node) {
+        std::vector<int> cpus = node_cpus(node);
+        if (cpus.empty()) {
+            return -ENOENT;
+        }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -errno;
+    }
+
+    // Place a page-aligned range on one node (mbind with MPOL_BIND, moving
+    // pages already touched). Returns 0 or -errno.
+    static int bind_memory(void* addr, size_t len, int node) {
+        constexpr int kMpolBind = 2;
+        constexpr unsigned kMpolMfMove = 1u << 1;
+        constexpr size_t kBitsPerWord = sizeof(unsigned long) * 8;
+
+        if (node < 0 || node >= kMaxNodes) {
+            return -EINVAL;
+        }
+
+        unsigned long mask[kMaxNodes / kBitsPerWord] = {};
+        mask[node / kBitsPerWord] = 1UL << (node % kBitsPerWord);
+        if (syscall(SYS_mbind, addr, len, kMpolBind, mask, kMaxNodes, kMpolMfMove) != 0) {
+            return -errno;
+        }
+        return 0;
+    }
+
+    // Parse a kernel cpu/node list such as "0-3,8,10-11"
+    static std::vector<int> parse_list(const std::string& text) {
+        std::vector<int> values;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = text.find(',', pos);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+
+            std::string range = text.substr(pos, end - pos);
+            pos = end + 1;
+
+            int first = 0;
+            int last = 0;
+            int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+            if (fields == 1) {
+                last = first;
+            } else if (fields != 2) {
+                continue;
+            }
+            for (int value = first; value <= last; ++value) {
+                values.push_back(value);
+            }
+        }
+        return values;
+    }
+
+private:
+    static std::string read_line(const std::string& file) {
+        std::ifstream in(file);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+};
+
+// Memory resource handing out whole pages bound to one NUMA node. Binding
+// is best effort: where mbind is unavailable the pages are placed by first
+// touch, which is why replicas are built on a thread pinned to the node.
+class NodeMemoryResource : public std::pmr::memory_resource {
+public:
+    explicit NodeMemoryResource(int node)
+        : _node(node) {}
+
+    // One resource per node, alive until exit so arenas can outlive their owner
+    static NodeMemoryResource* for_node(int node) {
+        static std::mutex mutex;
+        static std::deque<NodeMemoryResource> resources;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        while (static_cast<int>(resources.size()) <= node) {
+            resources.emplace_back(static_cast<int>(resources.size()));
+        }
+        return &resources[node];
+    }
+
+    int node() const {
+        return _node;
+    }
+
+private:
+    static size_t page_round(size_t bytes) {
+        static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return (bytes + page - 1) / page * page;
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        (void)alignment; // Pages are aligned enough for anything
+        size_t len = page_round(std::max<size_t>(bytes, 1));
+        void* addr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        if (_node < HotNuma::node_count()) {
+            HotNuma::bind_memory(addr, len, _node);
+        }
+        return addr;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        (void)alignment;
+        munmap(p, page_round(std::max<size_t>(bytes, 1)));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    int _node;
+};
+
+// Snapshot replicated once per NUMA node so every reader gets a copy in its
+// local memory. publish() copies the master on a thread pinned to each node
+// into an arena of node-bound pages; std::pmr types are copied deeply into
+// that arena, other members allocate by first touch on the pinned thread.
+// Readers pick the replica of the node they run on.
+//
+// With a single node the master itself is published. The node count can be
+// forced higher to exercise replication on a single-node host; extra nodes
+// then get unbound copies.
+template <typename T>
+class HotReplicated {
+public:
+    using Snapshot = std::shared_ptr<const T>;
+
+    explicit HotReplicated(int nodes = 0)
+        : _nodes(nodes > 0 ? nodes : HotNuma::node_count()) {
+        for (int node = 0; node < _nodes; ++node) {
+            _replicas.push_back(std::make_unique<HotValue<T>>());
+        }
+
+        long cpus = sysconf(_SC_NPROCESSORS_CONF);
+        _cpu_nodes.assign(static_cast<size_t>(std::max(1L, cpus)), 0);
+        for (int node = 0; node < HotNuma::node_count(); ++node) {
+            for (int cpu : HotNuma::node_cpus(node)) {
+                if (cpu >= 0 && static_cast<size_t>(cpu) < _cpu_nodes.size()) {
+                    _cpu_nodes[cpu] = node % _nodes;
+                }
+            }
+        }
+    }
+
+    HotReplicated(const HotReplicated&) = delete;
+    HotReplicated& operator=(const HotReplicated&) = delete;
+
+    int nodes() const {
+        return _nodes;
+    }
+
+    // Build every replica, then publish them together
+    void publish(const Snapshot& master) {
+        if (_nodes == 1 || !master) {
+            _replicas[0]->publish(master);
+            _version.fetch_add(1, std::memory_order_release);
+            return;
+        }
+
+        uint64_t generation = _version.load(std::memory_order_relaxed) + 1;
+        std::vector<Snapshot> copies(static_cast<size_t>(_nodes));
+        std::vector<std::thread> builders;
+        for (int node = 0; node < _nodes; ++node) {
+            builders.emplace_back([&, node]() {
+                if (node < HotNuma::node_count()) {
+                    HotNuma::pin_thread(node);
+                }
+                auto arena = std::make_shared<HotArena>(generation, NodeMemoryResource::for_node(node));
+                copies[node] = HotArena::make<T>(arena, *master);
+            });
+        }
+        for (auto& builder : builders) {
+            builder.join();
+        }
+
+        for (int node = 0; node < _nodes; ++node) {
+            _replicas[node]->publish(std::move(copies[node]));
+        }
+        _version.fetch_add(1, std::memory_order_release);
+    }
+
+    // Replica of the node the calling thread runs on
+    Snapshot load() const {
+        return load(local_node());
+    }
+
+    Snapshot load(int node) const {
+        return _replicas[static_cast<size_t>(node) % _replicas.size()]->load();
+    }
+
+    // Number of publish() calls so far
+    uint64_t version() const {
+        return _version.load(std::memory_order_acquire);
+    }
+
+    int local_node() const {
+        int cpu = sched_getcpu(); // vDSO, no system call
+        if (cpu < 0 || static_cast<size_t>(cpu) >= _cpu_nodes.size()) {
+            return 0;
+        }
+        return _cpu_nodes[cpu];
+    }
+
+private:
+    const int _nodes;
+    std::vector<std::unique_ptr<HotValue<T>>> _replicas; // One per node
+    std::vector<int> _cpu_nodes;                         // Replica index of each CPU
+    std::atomic<uint64_t> _version{0};
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "hot_loader.h"
+
+// Effective config composed from an ordered list of layer files, e.g.
+// base + region + host + emergency override. Later layers win.
+//
+// The first layer is the watched file and must exist, the other layers are
+// tracked as dependencies and may be missing (treated as empty). Each layer
+// is kept in parsed form together with the hash of its content. A changed
+// layer is parsed again only if its hash differs, and only the keys it
+// added, removed or changed are recomputed in the merged view, which is
+// then published as a new immutable snapshot.
+class HotOverlayTask : public HotLoadTask {
+public:
+    using Layer = std::unordered_map<std::string, std::string>;
+    using Config = std::unordered_map<std::string, std::string>;
+
+    explicit HotOverlayTask(const std::vector<std::string>& layers)
+        : HotLoadTask(layers.empty() ? std::string() : layers[0]) {
+        for (const auto& layer : layers) {
+            _paths.push_back(HotLoadTask::absolute_path(layer));
+        }
+
+        _layers.resize(_paths.size());
+        _hashes.resize(_paths.size());
+        for (size_t i = 0; i < _paths.size(); ++i) {
+            _hashes[i] = layer_hash(_paths[i]);
+            parse_layer(_paths[i], _layers[i]);
+            for (const auto& [key, value] : _layers[i]) {
+                _merged[key] = value;
+                _owners[key] = i;
+            }
+        }
+
+        track_layers();
+        _config.publish(std::make_shared<const Config>(_merged));
+    }
+
+    // Current merged config, safe to call from any thread
+    std::shared_ptr<const Config> config() const {
+        return _config.load();
+    }
+
+    // Number of merged snapshots published so far, including the initial one
+    uint64_t generation() const {
+        return _config.version();
+    }
+
+    // A reload of the first layer supersedes dependency changes queued with
+    // it, so every layer is checked
+    void on_reload() override {
+        bool changed = false;
+        for (size_t i = 0; i < _paths.size(); ++i) {
+            changed |= reload_if_changed(i);
+        }
+        publish_if(changed);
+        track_layers();
+    }
+
+    // Each changed layer is delivered on its own
+    void on_dependency_reload(const std::string& file) override {
+        bool changed = false;
+        for (size_t i = 1; i < _paths.size(); ++i) {
+            if (_paths[i] == file) {
+                changed |= reload_if_changed(i);
+            }
+        }
+        publish_if(changed);
+        track_layers();
+    }
+
+protected:
+    // Parse one layer file, a missing file is an empty layer. The default
+    // format is one "key = value" per line with '#' comments; override for
+    // other formats. Returning false keeps the previous version of the layer.
+    virtual bool parse_layer(const std::string& file, Layer& layer) {
+        std::ifstream in(file);
+        if (!in) {
+            return true; // Missing layer
+        }
+
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) {
+                line.erase(comment);
+            }
+
+            size_t eq = line.find('=');
+            if (eq == std::string::npos) {
+                continue;
+            }
+
+            std::string key = trim(line.substr(0, eq));
+            if (!key.empty()) {
+                layer[std::move(key)] = trim(line.substr(eq + 1));
+            }
+        }
+        return true;
+    }
+
+private:
+    static std::string trim(const std::string& s) {
+        size_t begin = s.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            return {};
+        }
+        size_t end = s.find_last_not_of(" \t\r");
+        return s.substr(begin, end - begin + 1);
+    }
+
+    void track_layers() {
+        // Tracked again on every reload, the dependency set is replaced each time
+        for (size_t i = 1; i < _paths.size(); ++i) {
+            track_dependency(_paths[i]);
+        }
+    }
+
+    // Hash of a layer's content, 0 for a missing layer
+    static uint64_t layer_hash(const std::string& file) {
+        std::shared_ptr<const FileSnapshot> content = FileSnapshot::read(file, 0);
+        return content ? hot_hash64(content->data.data(), content->data.size()) : 0;
+    }
+
+    // Hashed before parsing: a write in between changes the hash again and
+    // is picked up by the callback it triggers
+    bool reload_if_changed(size_t index) {
+        uint64_t hash = layer_hash(_paths[index]);
+        return hash != _hashes[index] && reload_layer(index, hash);
+    }
+
+    void publish_if(bool changed) {
+        if (changed) {
+            _config.publish(std::make_shared<const Config>(_merged));
+        }
+    }
+
+    // Returns true if the merged view changed
+    bool reload_layer(size_t index, uint64_t hash) {
+        Layer layer;
+        if (!parse_layer(_paths[index], layer)) {
+            return false; // Keep the previous version of this layer, retried on the next callback
+        }
+
+        // Keys whose value in this layer was added, removed or changed
+        std::unordered_set<std::string> affected;
+        const Layer& old_layer = _layers[index];
+        for (const auto& [key, value] : old_layer) {
+            auto it = layer.find(key);
+            if (it == layer.end() || it->second != value) {
+                affected.insert(key);
+            }
+        }
+        for (const auto& [key, value] : layer) {
+            if (old_layer.find(key) == old_layer.end()) {
+                affected.insert(key);
+            }
+        }
+
+        _layers[index] = std::move(layer);
+        _hashes[index] = hash;
+
+        bool changed = false;
+        for (const auto& key : affected) {
+            changed |= recompute_key(key, index);
+        }
+        return changed;
+    }
+
+    // Find the topmost layer that defines a key affected by a change of the
+    // given layer. Returns true if the merged value changed.
+    bool recompute_key(const std::string& key, size_t index) {
+        auto owner = _owners.find(key);
+        if (owner != _owners.end() && owner->second > index) {
+            return false; // Shadowed by a higher layer that did not change
+        }
+
+        for (size_t i = _layers.size(); i-- > 0;) {
+            auto it = _layers[i].find(key);
+            if (it != _layers[i].end()) {
+                auto merged = _merged.find(key);
+                bool changed = (merged == _merged.end() || merged->second != it->second);
+                _merged[key] = it->second;
+                _owners[key] = i;
+                return changed;
+            }
+        }
+
+        _owners.erase(key);
+        return _merged.erase(key) > 0;
+    }
+
+private:
+    std::vector<std::string> _paths;                 // Layer files, lowest priority first
+    std::vector<Layer> _layers;                      // Parsed form of each layer
+    std::vector<uint64_t> _hashes;                   // Content hash of each layer when parsed
+    Config _merged;                                  // Working copy of the merged view
+    std::unordered_map<std::string, size_t> _owners; // Layer providing each merged key
+    HotValue<Config> _config;                        // Published merged snapshot
+};
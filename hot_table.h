@@ -0,0 +1,780 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "hot_loader.h"
+
+// How a delimited file is parsed into a HotTable. Column names refer to the
+// header line, or to "0", "1", ... when the file has none.
+struct HotTableOptions {
+    char delimiter = ',';              // '\t' for TSV; quoting is only honoured for other delimiters
+    bool header = true;                // First record names the columns
+    bool append_only = false;          // File only grows, new records are parsed incrementally
+    std::vector<std::string> hashed;   // Columns with a hash index for find()
+    std::vector<std::string> sorted;   // Columns with a sorted index for range()
+    std::vector<std::string> numeric;  // Columns also stored as double
+};
+
+// Immutable columnar table. Every column is dictionary encoded: each distinct
+// value is stored once in a per-column string pool and rows hold 32-bit ids,
+// so equality filters compare integers and run as tight loops over one array.
+// Numeric columns additionally keep a double per row (NaN when a cell does not
+// parse).
+//
+// A table is a list of segments: a full load builds one, every incremental
+// append of an append-only file adds one. Row numbers are global and follow
+// the file order; functions returning several rows return them ascending.
+class HotTable {
+public:
+    constexpr static size_t npos = static_cast<size_t>(-1);
+
+    size_t rows() const {
+        return _rows;
+    }
+
+    size_t columns() const {
+        return _layout->names.size();
+    }
+
+    const std::vector<std::string>& header() const {
+        return _layout->names;
+    }
+
+    // Column number by name, -1 if unknown
+    int column(std::string_view name) const {
+        for (size_t i = 0; i < _layout->names.size(); ++i) {
+            if (_layout->names[i] == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Number of segments, i.e. the full load plus appends since then
+    size_t segments() const {
+        return _segments.size();
+    }
+
+    // Cell content, empty for missing trailing fields. Valid while the table is held.
+    std::string_view cell(size_t row, size_t col) const {
+        size_t local = 0;
+        const Segment& segment = locate(row, local);
+        const Column& column = segment.columns[col];
+        return column.value(column.ids[local]);
+    }
+
+    // Cell as a number, NaN if the column is not numeric or the cell does not parse
+    double number(size_t row, size_t col) const {
+        if (!_layout->numeric[col]) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        size_t local = 0;
+        return locate(row, local).columns[col].numbers[local];
+    }
+
+    // First row whose cell equals key, npos if none
+    size_t find_first(size_t col, std::string_view key) const {
+        for (size_t s = 0; s < _segments.size(); ++s) {
+            const Column& column = _segments[s]->columns[col];
+            uint32_t id = column.lookup(key);
+            if (id == kMissing) {
+                continue;
+            }
+            if (_layout->hashed[col]) {
+                return _bases[s] + column.postings[column.posting_offsets[id]];
+            }
+            for (size_t r = 0; r < column.ids.size(); ++r) {
+                if (column.ids[r] == id) {
+                    return _bases[s] + r;
+                }
+            }
+        }
+        return npos;
+    }
+
+    // Rows whose cell equals key, through the hash index if the column has one
+    std::vector<size_t> find(size_t col, std::string_view key) const {
+        if (!_layout->hashed[col]) {
+            return select_equal(col, key);
+        }
+
+        std::vector<size_t> rows;
+        for (size_t s = 0; s < _segments.size(); ++s) {
+            const Column& column = _segments[s]->columns[col];
+            uint32_t id = column.lookup(key);
+            if (id == kMissing) {
+                continue;
+            }
+            for (uint32_t k = column.posting_offsets[id]; k < column.posting_offsets[id + 1]; ++k) {
+                rows.push_back(_bases[s] + column.postings[k]);
+            }
+        }
+        return rows;
+    }
+
+    // Rows with lo <= cell <= hi in byte order; needs a sorted index on col
+    std::vector<size_t> range(size_t col, std::string_view lo, std::string_view hi) const {
+        std::vector<size_t> rows;
+        if (!_layout->sorted[col] || _layout->numeric[col]) {
+            return rows;
+        }
+
+        for (size_t s = 0; s < _segments.size(); ++s) {
+            const Column& column = _segments[s]->columns[col];
+            auto key = [&column](uint32_t row) { return column.value(column.ids[row]); };
+            auto first = std::lower_bound(column.order.begin(), column.order.end(), lo,
+                                          [&key](uint32_t row, std::string_view v) { return key(row) < v; });
+            auto last = std::upper_bound(first, column.order.end(), hi,
+                                         [&key](std::string_view v, uint32_t row) { return v < key(row); });
+            for (auto it = first; it != last; ++it) {
+                rows.push_back(_bases[s] + *it);
+            }
+        }
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    }
+
+    // Rows with lo <= number <= hi; needs a sorted index on a numeric col
+    std::vector<size_t> range(size_t col, double lo, double hi) const {
+        std::vector<size_t> rows;
+        if (!_layout->sorted[col] || !_layout->numeric[col]) {
+            return rows;
+        }
+
+        for (size_t s = 0; s < _segments.size(); ++s) {
+            const Column& column = _segments[s]->columns[col];
+            const std::vector<double>& numbers = column.numbers;
+            auto first = std::lower_bound(column.order.begin(), column.order.end(), lo,
+                                          [&numbers](uint32_t row, double v) { return numbers[row] < v; });
+            auto last = std::upper_bound(first, column.order.end(), hi,
+                                         [&numbers](double v, uint32_t row) { return v < numbers[row]; });
+            for (auto it = first; it != last; ++it) {
+                rows.push_back(_bases[s] + *it);
+            }
+        }
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    }
+
+    // Full scan for cell == value without an index
+    std::vector<size_t> select_equal(size_t col, std::string_view value) const {
+        std::vector<size_t> rows;
+        for (size_t s = 0; s < _segments.size(); ++s) {
+            const Column& column = _segments[s]->columns[col];
+            uint32_t id = column.lookup(value);
+            if (id != kMissing) {
+                gather(column.ids.size(), _bases[s], rows, [&](size_t r) { return column.ids[r] == id; });
+            }
+        }
+        return rows;
+    }
+
+    // Full scan for lo <= number <= hi on a numeric column
+    std::vector<size_t> select_between(size_t col, double lo, double hi) const {
+        std::vector<size_t> rows;
+        if (!_layout->numeric[col]) {
+            return rows;
+        }
+        for (size_t s = 0; s < _segments.size(); ++s) {
+            const double* numbers = _segments[s]->columns[col].numbers.data();
+            gather(_segments[s]->rows, _bases[s], rows, [=](size_t r) {
+                return (numbers[r] >= lo) & (numbers[r] <= hi); // NaN never matches
+            });
+        }
+        return rows;
+    }
+
+    size_t count_equal(size_t col, std::string_view value) const {
+        size_t count = 0;
+        for (const auto& segment : _segments) {
+            const Column& column = segment->columns[col];
+            uint32_t id = column.lookup(value);
+            if (id == kMissing) {
+                continue;
+            }
+            const uint32_t* ids = column.ids.data();
+            for (size_t r = 0; r < column.ids.size(); ++r) {
+                count += (ids[r] == id);
+            }
+        }
+        return count;
+    }
+
+    // Sum of a numeric column, cells that do not parse count as 0
+    double sum(size_t col) const {
+        double total = 0;
+        if (!_layout->numeric[col]) {
+            return total;
+        }
+        for (const auto& segment : _segments) {
+            for (double value : segment->columns[col].numbers) {
+                total += std::isnan(value) ? 0.0 : value;
+            }
+        }
+        return total;
+    }
+
+    // Approximate bytes held by the table, shared segments included
+    size_t memory_usage() const {
+        size_t bytes = sizeof(HotTable);
+        for (const auto& segment : _segments) {
+            for (const Column& column : segment->columns) {
+                bytes += column.memory_usage();
+            }
+        }
+        return bytes;
+    }
+
+private:
+    friend class HotTableTask;
+
+    constexpr static uint32_t kMissing = std::numeric_limits<uint32_t>::max();
+
+    struct Layout {
+        char delimiter = ',';
+        std::vector<std::string> names;
+        std::vector<bool> hashed;
+        std::vector<bool> sorted;
+        std::vector<bool> numeric;
+    };
+
+    struct Column {
+        std::vector<uint32_t> ids;             // Dictionary id of every row
+        std::vector<size_t> offsets{0};        // Value k is pool[offsets[k], offsets[k + 1])
+        std::string pool;                      // Distinct values back to back
+        std::vector<uint32_t> slots;           // Open addressing dictionary lookup, id + 1, 0 is empty
+        std::vector<double> numbers;           // Numeric columns only
+        std::vector<uint32_t> posting_offsets; // Hash index: rows of id k are
+        std::vector<uint32_t> postings;        // postings[posting_offsets[k], posting_offsets[k + 1])
+        std::vector<uint32_t> order;           // Sorted index: rows in key order
+
+        size_t dictionary_size() const {
+            return offsets.size() - 1;
+        }
+
+        std::string_view value(uint32_t id) const {
+            return std::string_view(pool.data() + offsets[id], offsets[id + 1] - offsets[id]);
+        }
+
+        uint32_t lookup(std::string_view key) const {
+            if (slots.empty()) {
+                return kMissing;
+            }
+            size_t mask = slots.size() - 1;
+            for (size_t slot = hot_hash64(key.data(), key.size()) & mask;; slot = (slot + 1) & mask) {
+                uint32_t entry = slots[slot];
+                if (entry == 0) {
+                    return kMissing;
+                }
+                if (value(entry - 1) == key) {
+                    return entry - 1;
+                }
+            }
+        }
+
+        uint32_t intern(std::string_view key) {
+            if ((dictionary_size() + 1) * 2 > slots.size()) {
+                rehash(std::max<size_t>(16, slots.size() * 2));
+            }
+
+            size_t mask = slots.size() - 1;
+            size_t slot = hot_hash64(key.data(), key.size()) & mask;
+            for (; slots[slot] != 0; slot = (slot + 1) & mask) {
+                if (value(slots[slot] - 1) == key) {
+                    return slots[slot] - 1;
+                }
+            }
+
+            uint32_t id = static_cast<uint32_t>(dictionary_size());
+            pool.append(key.data(), key.size());
+            offsets.push_back(pool.size());
+            slots[slot] = id + 1;
+            return id;
+        }
+
+        void rehash(size_t capacity) {
+            slots.assign(capacity, 0);
+            size_t mask = capacity - 1;
+            for (uint32_t id = 0; id < dictionary_size(); ++id) {
+                std::string_view key = value(id);
+                size_t slot = hot_hash64(key.data(), key.size()) & mask;
+                while (slots[slot] != 0) {
+                    slot = (slot + 1) & mask;
+                }
+                slots[slot] = id + 1;
+            }
+        }
+
+        size_t memory_usage() const {
+            return ids.capacity() * sizeof(uint32_t) + offsets.capacity() * sizeof(size_t) + pool.capacity() +
+                   slots.capacity() * sizeof(uint32_t) + numbers.capacity() * sizeof(double) +
+                   (posting_offsets.capacity() + postings.capacity() + order.capacity()) * sizeof(uint32_t);
+        }
+    };
+
+    struct Segment {
+        size_t rows = 0;
+        std::vector<Column> columns;
+    };
+
+    // Append matching row numbers without a branch per row: the index is
+    // always written and the length only advances on a match
+    template <typename Match>
+    static void gather(size_t count, size_t base, std::vector<size_t>& rows, Match match) {
+        size_t size = rows.size();
+        rows.resize(size + count);
+        size_t* out = rows.data() + size;
+        size_t n = 0;
+        for (size_t r = 0; r < count; ++r) {
+            out[n] = base + r;
+            n += match(r) ? 1 : 0;
+        }
+        rows.resize(size + n);
+    }
+
+    const Segment& locate(size_t row, size_t& local) const {
+        size_t s = static_cast<size_t>(std::upper_bound(_bases.begin(), _bases.end(), row) - _bases.begin()) - 1;
+        local = row - _bases[s];
+        return *_segments[s];
+    }
+
+    void add_segment(std::shared_ptr<const Segment> segment) {
+        _bases.push_back(_rows);
+        _rows += segment->rows;
+        _segments.push_back(std::move(segment));
+    }
+
+private:
+    std::shared_ptr<const Layout> _layout;
+    std::vector<std::shared_ptr<const Segment>> _segments; // Shared with the tables appended from this one
+    std::vector<size_t> _bases;                            // First global row of each segment
+    size_t _rows = 0;
+};
+
+// Task keeping a delimited file loaded as a HotTable. On every change the
+// file is parsed into a new table that is published atomically; readers keep
+// whatever table they hold.
+//
+// With append_only set, a change that only added bytes (same inode, the last
+// 4 KiB before the parsed end unchanged) parses just the new complete
+// records into one more segment, sharing all earlier ones. A record is only
+// taken once its newline is written. Anything else, or more than
+// kMaxSegments segments, triggers a full reload that compacts the table.
+class HotTableTask : public HotLoadTask {
+public:
+    constexpr static size_t kMaxSegments = 16;
+    constexpr static size_t kGuardBytes = 4096;
+
+    explicit HotTableTask(const std::string& file, HotTableOptions options = HotTableOptions())
+        : HotLoadTask(file), _options(std::move(options)) {
+        if (!reload()) {
+            _table.publish(empty_table()); // Readers never see null
+        }
+    }
+
+    // Current table, keep it for the duration of a request
+    std::shared_ptr<const HotTable> table() const {
+        return _table.load();
+    }
+
+    // Number of tables published so far
+    uint64_t generation() const {
+        return _table.version();
+    }
+
+    void on_reload() override {
+        if (_options.append_only && append()) {
+            return;
+        }
+        reload();
+    }
+
+    // Parse a whole text into a table, e.g. for offline tools
+    static std::shared_ptr<const HotTable> parse(const std::string& text, const HotTableOptions& options) {
+        size_t consumed = 0;
+        return parse_table(text, options, false, consumed);
+    }
+
+private:
+    static std::shared_ptr<const HotTable> parse_table(std::string_view text, const HotTableOptions& options,
+                                                       bool complete_only, size_t& consumed) {
+        std::vector<std::string_view> fields;
+        std::deque<std::string> unescaped;
+        size_t pos = 0;
+        char delimiter = options.delimiter;
+
+        // The header, or the first record when there is none, fixes the columns
+        size_t first = pos;
+        do {
+            first = pos;
+            if (!parse_record(text, pos, delimiter, complete_only, fields, unescaped)) {
+                return nullptr;
+            }
+        } while (blank(fields) && pos < text.size());
+        if (blank(fields)) {
+            return nullptr;
+        }
+
+        auto layout = std::make_shared<HotTable::Layout>();
+        layout->delimiter = delimiter;
+        for (size_t i = 0; i < fields.size(); ++i) {
+            layout->names.push_back(options.header ? std::string(fields[i]) : std::to_string(i));
+        }
+        if (!options.header) {
+            pos = first;
+        }
+
+        auto flags = [&layout](const std::vector<std::string>& names) {
+            std::vector<bool> set(layout->names.size(), false);
+            for (const auto& name : names) {
+                auto it = std::find(layout->names.begin(), layout->names.end(), name);
+                if (it != layout->names.end()) {
+                    set[static_cast<size_t>(it - layout->names.begin())] = true;
+                }
+            }
+            return set;
+        };
+        layout->hashed = flags(options.hashed);
+        layout->sorted = flags(options.sorted);
+        layout->numeric = flags(options.numeric);
+
+        auto table = std::make_shared<HotTable>();
+        table->_layout = std::move(layout);
+        table->add_segment(parse_segment(text, pos, *table->_layout, complete_only));
+        consumed = pos;
+        return table;
+    }
+
+    // Parse records from pos on into a segment, pos ends after the last record taken
+    static std::shared_ptr<const HotTable::Segment> parse_segment(std::string_view text, size_t& pos,
+                                                                  const HotTable::Layout& layout, bool complete_only) {
+        auto segment = std::make_shared<HotTable::Segment>();
+        segment->columns.resize(layout.names.size());
+
+        std::vector<std::string_view> fields;
+        std::deque<std::string> unescaped;
+        while (pos < text.size()) {
+            size_t next = pos;
+            if (!parse_record(text, next, layout.delimiter, complete_only, fields, unescaped)) {
+                break; // Incomplete last record, taken by a later append
+            }
+            pos = next;
+            if (blank(fields)) {
+                continue;
+            }
+
+            for (size_t col = 0; col < segment->columns.size(); ++col) {
+                HotTable::Column& column = segment->columns[col];
+                column.ids.push_back(column.intern(col < fields.size() ? fields[col] : std::string_view("", 0)));
+            }
+            ++segment->rows;
+        }
+
+        for (size_t col = 0; col < segment->columns.size(); ++col) {
+            build_indexes(segment->columns[col], layout.hashed[col], layout.sorted[col], layout.numeric[col]);
+        }
+        return segment;
+    }
+
+    static void build_indexes(HotTable::Column& column, bool hashed, bool sorted, bool numeric) {
+        size_t values = column.dictionary_size();
+
+        // Numbers are parsed once per distinct value
+        std::vector<double> value_numbers;
+        if (numeric) {
+            value_numbers.resize(values, std::numeric_limits<double>::quiet_NaN());
+            for (uint32_t id = 0; id < values; ++id) {
+                std::string_view text = column.value(id);
+                size_t begin = text.find_first_not_of(' ');
+                if (begin == std::string_view::npos) {
+                    continue;
+                }
+                text.remove_prefix(begin);
+                if (!text.empty() && text[0] == '+') {
+                    text.remove_prefix(1);
+                }
+                double number = 0;
+                auto result = std::from_chars(text.data(), text.data() + text.size(), number);
+                if (result.ec == std::errc() && text.find_first_not_of(' ', result.ptr - text.data()) ==
+                                                    std::string_view::npos) {
+                    value_numbers[id] = number;
+                }
+            }
+            column.numbers.resize(column.ids.size());
+            for (size_t r = 0; r < column.ids.size(); ++r) {
+                column.numbers[r] = value_numbers[column.ids[r]];
+            }
+        }
+
+        if (hashed) {
+            counting_sort(column.ids, values, column.posting_offsets, column.postings);
+        }
+
+        if (sorted) {
+            // Rank the distinct values, then bucket the rows by rank
+            std::vector<uint32_t> by_value;
+            for (uint32_t id = 0; id < values; ++id) {
+                if (!numeric || !std::isnan(value_numbers[id])) {
+                    by_value.push_back(id);
+                }
+            }
+            if (numeric) {
+                std::sort(by_value.begin(), by_value.end(),
+                          [&](uint32_t a, uint32_t b) { return value_numbers[a] < value_numbers[b]; });
+            } else {
+                std::sort(by_value.begin(), by_value.end(),
+                          [&](uint32_t a, uint32_t b) { return column.value(a) < column.value(b); });
+            }
+
+            std::vector<uint32_t> rank(values, kMissingRank);
+            for (uint32_t i = 0; i < by_value.size(); ++i) {
+                rank[by_value[i]] = i;
+            }
+
+            std::vector<uint32_t> ranks;
+            std::vector<uint32_t> ranked_rows;
+            ranks.reserve(column.ids.size());
+            for (size_t r = 0; r < column.ids.size(); ++r) {
+                uint32_t k = rank[column.ids[r]];
+                if (k != kMissingRank) {
+                    ranks.push_back(k);
+                    ranked_rows.push_back(static_cast<uint32_t>(r));
+                }
+            }
+
+            std::vector<uint32_t> offsets;
+            std::vector<uint32_t> order;
+            counting_sort(ranks, by_value.size(), offsets, order);
+            for (uint32_t& i : order) {
+                i = ranked_rows[i];
+            }
+            column.order = std::move(order);
+        }
+    }
+
+    constexpr static uint32_t kMissingRank = std::numeric_limits<uint32_t>::max();
+
+    // Stable bucket sort of positions by key, keys below buckets
+    static void counting_sort(const std::vector<uint32_t>& keys, size_t buckets, std::vector<uint32_t>& offsets,
+                              std::vector<uint32_t>& positions) {
+        offsets.assign(buckets + 1, 0);
+        for (uint32_t key : keys) {
+            ++offsets[key + 1];
+        }
+        for (size_t k = 0; k < buckets; ++k) {
+            offsets[k + 1] += offsets[k];
+        }
+
+        positions.resize(keys.size());
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            positions[cursor[keys[i]]++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    // Split one record starting at pos into fields. Fields quoted with '"'
+    // may hold delimiters, newlines and "" escapes. Returns false, leaving pos
+    // alone, if the text ends before the record's newline and complete_only
+    // is set.
+    static bool parse_record(std::string_view text, size_t& pos, char delimiter, bool complete_only,
+                             std::vector<std::string_view>& fields, std::deque<std::string>& unescaped) {
+        fields.clear();
+        unescaped.clear();
+        bool quoting = delimiter != '\t';
+        size_t n = text.size();
+        size_t i = pos;
+
+        while (true) {
+            if (quoting && i < n && text[i] == '"') {
+                size_t chunk = ++i;
+                std::string* buffer = nullptr;
+                size_t end = n;
+                while (true) {
+                    size_t quote = text.find('"', i);
+                    if (quote == std::string_view::npos) {
+                        if (complete_only) {
+                            return false;
+                        }
+                        i = n; // Unterminated quote runs to the end of the text
+                        break;
+                    }
+                    if (quote + 1 < n && text[quote + 1] == '"') {
+                        if (!buffer) {
+                            buffer = &unescaped.emplace_back();
+                        }
+                        buffer->append(text.data() + chunk, quote + 1 - chunk);
+                        i = chunk = quote + 2;
+                        continue;
+                    }
+                    end = quote;
+                    i = quote + 1;
+                    break;
+                }
+
+                if (buffer) {
+                    buffer->append(text.data() + chunk, end - chunk);
+                    fields.push_back(*buffer);
+                } else {
+                    fields.push_back(text.substr(chunk, end - chunk));
+                }
+
+                // Anything between the closing quote and the delimiter is dropped
+                while (i < n && text[i] != delimiter && text[i] != '\n') {
+                    ++i;
+                }
+            } else {
+                size_t end = i;
+                while (end < n && text[end] != delimiter && text[end] != '\n') {
+                    ++end;
+                }
+                std::string_view field = text.substr(i, end - i);
+                if ((end == n || text[end] == '\n') && !field.empty() && field.back() == '\r') {
+                    field.remove_suffix(1);
+                }
+                fields.push_back(field);
+                i = end;
+            }
+
+            if (i >= n) {
+                if (complete_only) {
+                    return false;
+                }
+                pos = n;
+                return true;
+            }
+            if (text[i] == '\n') {
+                pos = i + 1;
+                return true;
+            }
+            ++i; // Delimiter
+        }
+    }
+
+    static bool blank(const std::vector<std::string_view>& fields) {
+        return fields.size() == 1 && fields[0].empty();
+    }
+
+    static std::shared_ptr<const HotTable> empty_table() {
+        auto layout = std::make_shared<HotTable::Layout>();
+        auto table = std::make_shared<HotTable>();
+        table->_layout = std::move(layout);
+        return table;
+    }
+
+    bool reload() {
+        std::shared_ptr<const FileSnapshot> content = snapshot();
+        if (!content) {
+            return false;
+        }
+
+        size_t consumed = 0;
+        std::shared_ptr<const HotTable> table = parse_table(content->data, _options, _options.append_only, consumed);
+        if (!table) {
+            if (_options.append_only) {
+                _consumed = 0; // Nothing complete yet, the next change parses from the start
+                _fingerprint = FileFingerprint();
+            }
+            return false;
+        }
+
+        _fingerprint = content->fingerprint;
+        _consumed = consumed;
+        _guard = guard_hash(std::string_view(content->data).substr(0, consumed));
+        _table.publish(std::move(table));
+        return true;
+    }
+
+    // Parse what was appended since the last load. Returns false if the file
+    // was not just appended to and needs a full reload.
+    bool append() {
+        std::shared_ptr<const HotTable> current = _table.load();
+        if (!_fingerprint.valid() || !current || current->segments() >= kMaxSegments) {
+            return false;
+        }
+
+        int fd = ::open(watch_file().c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+
+        std::string tail;
+        bool appended = read_tail(fd, tail);
+        close(fd);
+        if (!appended) {
+            return false;
+        }
+
+        // tail starts with the guard bytes that precede the parsed end
+        size_t guard_bytes = std::min(_consumed, kGuardBytes);
+        size_t pos = guard_bytes;
+        std::shared_ptr<const HotTable::Segment> segment = parse_segment(tail, pos, *current->_layout, true);
+        if (segment->rows == 0) {
+            return true; // Only a partial record so far
+        }
+
+        auto table = std::make_shared<HotTable>(*current);
+        table->add_segment(std::move(segment));
+
+        _consumed += pos - guard_bytes;
+        _guard = guard_hash(std::string_view(tail).substr(0, pos));
+        _table.publish(std::move(table));
+        return true;
+    }
+
+    // Read from the guard region to the end if the file only grew
+    bool read_tail(int fd, std::string& tail) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_dev != _fingerprint.dev || st.st_ino != _fingerprint.ino ||
+            static_cast<size_t>(st.st_size) < _consumed) {
+            return false;
+        }
+
+        size_t guard_bytes = std::min(_consumed, kGuardBytes);
+        off_t offset = static_cast<off_t>(_consumed - guard_bytes);
+        char buf[64 * 1024];
+        while (true) {
+            ssize_t len = ::pread(fd, buf, sizeof(buf), offset);
+            if (len < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            if (len == 0) {
+                break;
+            }
+            tail.append(buf, static_cast<size_t>(len));
+            offset += len;
+        }
+
+        return tail.size() >= guard_bytes && guard_hash(std::string_view(tail).substr(0, guard_bytes)) == _guard;
+    }
+
+    // Hash of the last kGuardBytes of the parsed text
+    static uint64_t guard_hash(std::string_view parsed) {
+        size_t len = std::min(parsed.size(), kGuardBytes);
+        return hot_hash64(parsed.data() + parsed.size() - len, len);
+    }
+
+private:
+    const HotTableOptions _options;
+    HotValue<HotTable> _table;
+
+    // Append state, only touched from the constructor and the loader thread
+    FileFingerprint _fingerprint;
+    size_t _consumed = 0; // Bytes of the file parsed into the current table
+    uint64_t _guard = 0;
+};